@@ -0,0 +1,277 @@
+#ifndef assembly_kernels_h
+#define assembly_kernels_h
+
+#include <deal.II/base/exceptions.h>
+#include <deal.II/base/geometry_info.h>
+#include <deal.II/base/point.h>
+#include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/tensor.h>
+
+#include <deal.II/dofs/dof_accessor.h>
+#include <deal.II/dofs/dof_handler.h>
+
+#include <deal.II/fe/fe_q.h>
+
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/sparse_matrix.h>
+#include <deal.II/lac/vector.h>
+
+#include <batched_scatter.h>
+
+#include <memory>
+#include <vector>
+
+using namespace dealii;
+
+
+/**
+ * @p base to the power @p exponent, usable in constant expressions.
+ */
+constexpr unsigned int
+kernel_power(const unsigned int base, const unsigned int exponent)
+{
+  return exponent == 0 ? 1 : base * kernel_power(base, exponent - 1);
+}
+
+
+
+/**
+ * The coefficient of the Laplace operator in step-3.
+ */
+struct UnitCoefficient
+{
+  template <int dim>
+  double
+  operator()(const Point<dim> &) const
+  {
+    return 1.;
+  }
+};
+
+
+
+/**
+ * The cell matrix of $-\nabla \cdot a(x) \nabla u = f$ with constant $f$,
+ * for FE_Q<dim>(degree) and QGauss<dim>(n_q_points_1d), on cells with a
+ * d-linear mapping as in MappingQ1.
+ *
+ * The number of DoFs and quadrature points are compile-time constants, and
+ * the values and reference gradients of the shape functions are tabulated
+ * once in contiguous arrays, with the DoF index running fastest. The
+ * compiler can then unroll and vectorize the loops of compute(), which the
+ * run-time sizes of FEValues and its accessors prevent.
+ *
+ * The tables are large for high degrees in 3d, so objects of this class
+ * should be created on the heap.
+ */
+template <int dim, int degree, int n_q_points_1d>
+class LaplaceKernel
+{
+public:
+  static constexpr unsigned int dofs_per_cell = kernel_power(degree + 1, dim);
+  static constexpr unsigned int n_q_points = kernel_power(n_q_points_1d, dim);
+  static constexpr unsigned int n_vertices =
+    GeometryInfo<dim>::vertices_per_cell;
+
+  LaplaceKernel();
+
+  /**
+   * Compute the cell matrix and right hand side of the cell with the given
+   * @p vertices, in the order of GeometryInfo. @p coefficient is called
+   * with the real quadrature points.
+   */
+  template <typename Coefficient>
+  void
+  compute(const Point<dim> (&vertices)[n_vertices],
+          const Coefficient & coefficient,
+          const double        rhs_value,
+          FullMatrix<double> &cell_matrix,
+          Vector<double> &    cell_rhs) const;
+
+protected:
+  double weights[n_q_points];
+  double values[n_q_points][dofs_per_cell];
+  double gradients[n_q_points][dim][dofs_per_cell];
+  double vertex_values[n_q_points][n_vertices];
+  double vertex_gradients[n_q_points][dim][n_vertices];
+};
+
+
+
+template <int dim, int degree, int n_q_points_1d>
+constexpr unsigned int LaplaceKernel<dim, degree, n_q_points_1d>::dofs_per_cell;
+
+template <int dim, int degree, int n_q_points_1d>
+constexpr unsigned int LaplaceKernel<dim, degree, n_q_points_1d>::n_q_points;
+
+template <int dim, int degree, int n_q_points_1d>
+constexpr unsigned int LaplaceKernel<dim, degree, n_q_points_1d>::n_vertices;
+
+
+
+template <int dim, int degree, int n_q_points_1d>
+LaplaceKernel<dim, degree, n_q_points_1d>::LaplaceKernel()
+{
+  const FE_Q<dim>   fe(degree);
+  const QGauss<dim> quadrature(n_q_points_1d);
+  AssertDimension(fe.dofs_per_cell, dofs_per_cell);
+  AssertDimension(quadrature.size(), n_q_points);
+
+  for (unsigned int q = 0; q < n_q_points; ++q)
+    {
+      const Point<dim> &p = quadrature.point(q);
+      weights[q]          = quadrature.weight(q);
+
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+        {
+          values[q][i]                  = fe.shape_value(i, p);
+          const Tensor<1, dim> gradient = fe.shape_grad(i, p);
+          for (unsigned int d = 0; d < dim; ++d)
+            gradients[q][d][i] = gradient[d];
+        }
+
+      for (unsigned int v = 0; v < n_vertices; ++v)
+        {
+          vertex_values[q][v] =
+            GeometryInfo<dim>::d_linear_shape_function(p, v);
+          const Tensor<1, dim> gradient =
+            GeometryInfo<dim>::d_linear_shape_function_gradient(p, v);
+          for (unsigned int d = 0; d < dim; ++d)
+            vertex_gradients[q][d][v] = gradient[d];
+        }
+    }
+}
+
+
+
+template <int dim, int degree, int n_q_points_1d>
+template <typename Coefficient>
+void
+LaplaceKernel<dim, degree, n_q_points_1d>::compute(
+  const Point<dim> (&vertices)[n_vertices],
+  const Coefficient & coefficient,
+  const double        rhs_value,
+  FullMatrix<double> &cell_matrix,
+  Vector<double> &    cell_rhs) const
+{
+  double matrix[dofs_per_cell][dofs_per_cell] = {};
+  double rhs[dofs_per_cell]                   = {};
+  double real_gradients[dim][dofs_per_cell];
+
+  for (unsigned int q = 0; q < n_q_points; ++q)
+    {
+      Point<dim>     x;
+      Tensor<2, dim> jacobian;
+      for (unsigned int v = 0; v < n_vertices; ++v)
+        for (unsigned int d = 0; d < dim; ++d)
+          {
+            x[d] += vertices[v][d] * vertex_values[q][v];
+            for (unsigned int e = 0; e < dim; ++e)
+              jacobian[d][e] += vertices[v][d] * vertex_gradients[q][e][v];
+          }
+
+      const double         JxW     = weights[q] * determinant(jacobian);
+      const Tensor<2, dim> inverse = invert(jacobian);
+
+      // The real gradients are J^{-T} times the reference gradients.
+      for (unsigned int d = 0; d < dim; ++d)
+        for (unsigned int i = 0; i < dofs_per_cell; ++i)
+          {
+            double sum = 0;
+            for (unsigned int e = 0; e < dim; ++e)
+              sum += inverse[e][d] * gradients[q][e][i];
+            real_gradients[d][i] = sum;
+          }
+
+      const double factor = coefficient(x) * JxW;
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+        for (unsigned int j = 0; j < dofs_per_cell; ++j)
+          {
+            double sum = 0;
+            for (unsigned int d = 0; d < dim; ++d)
+              sum += real_gradients[d][i] * real_gradients[d][j];
+            matrix[i][j] += factor * sum;
+          }
+
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+        rhs[i] += values[q][i] * rhs_value * JxW;
+    }
+
+  for (unsigned int i = 0; i < dofs_per_cell; ++i)
+    {
+      for (unsigned int j = 0; j < dofs_per_cell; ++j)
+        cell_matrix(i, j) = matrix[i][j];
+      cell_rhs(i) = rhs[i];
+    }
+}
+
+
+
+/**
+ * Assemble the Laplace system with LaplaceKernel into @p matrix and @p rhs,
+ * for an FE_Q of the given degree and a Gauss formula with degree+1 points
+ * per direction.
+ */
+template <int dim, int degree, typename Coefficient>
+void
+assemble_laplace_system(const DoFHandler<dim> &dof_handler,
+                        const Coefficient &    coefficient,
+                        const double           rhs_value,
+                        SparseMatrix<double> & matrix,
+                        Vector<double> &       rhs)
+{
+  typedef LaplaceKernel<dim, degree, degree + 1> Kernel;
+  const std::unique_ptr<const Kernel> kernel(new Kernel());
+
+  FullMatrix<double> cell_matrix(Kernel::dofs_per_cell, Kernel::dofs_per_cell);
+  Vector<double>     cell_rhs(Kernel::dofs_per_cell);
+  std::vector<types::global_dof_index> local_dof_indices(Kernel::dofs_per_cell);
+  Point<dim>                           vertices[Kernel::n_vertices];
+
+  BatchedScatter scatter;
+  for (const auto &cell : dof_handler.active_cell_iterators())
+    {
+      for (unsigned int v = 0; v < Kernel::n_vertices; ++v)
+        vertices[v] = cell->vertex(v);
+      kernel->compute(vertices, coefficient, rhs_value, cell_matrix, cell_rhs);
+
+      cell->get_dof_indices(local_dof_indices);
+      scatter.add(cell_matrix, cell_rhs, local_dof_indices, matrix, rhs);
+    }
+}
+
+
+
+/**
+ * Pick the instance of assemble_laplace_system() for the degree of the
+ * finite element of @p dof_handler, which has to be an FE_Q of degree 1 to 4.
+ */
+template <int dim, typename Coefficient>
+void
+dispatch_laplace_assembly(const DoFHandler<dim> &dof_handler,
+                          const Coefficient &    coefficient,
+                          const double           rhs_value,
+                          SparseMatrix<double> & matrix,
+                          Vector<double> &       rhs)
+{
+  typedef void (*Assembler)(const DoFHandler<dim> &,
+                            const Coefficient &,
+                            const double,
+                            SparseMatrix<double> &,
+                            Vector<double> &);
+  static const Assembler assemblers[] = {
+    &assemble_laplace_system<dim, 1, Coefficient>,
+    &assemble_laplace_system<dim, 2, Coefficient>,
+    &assemble_laplace_system<dim, 3, Coefficient>,
+    &assemble_laplace_system<dim, 4, Coefficient>};
+
+  const unsigned int degree = dof_handler.get_fe().degree;
+  AssertThrow(degree >= 1 && degree <= 4 &&
+                dof_handler.get_fe().get_name() == FE_Q<dim>(degree).get_name(),
+              ExcMessage("The assembly kernels exist for FE_Q of degree 1 "
+                         "to 4 only."));
+
+  assemblers[degree - 1](dof_handler, coefficient, rhs_value, matrix, rhs);
+}
+
+#endif
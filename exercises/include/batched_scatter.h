@@ -0,0 +1,143 @@
+#ifndef batched_scatter_h
+#define batched_scatter_h
+
+#include <deal.II/lac/affine_constraints.h>
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/sparse_matrix.h>
+#include <deal.II/lac/vector.h>
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+using namespace dealii;
+
+
+/**
+ * Adds cell matrices and right hand sides to a square SparseMatrix and a
+ * Vector.
+ *
+ * Calling SparseMatrix::add(i, j, value) for each entry of a cell matrix
+ * searches the row of i for column j every time. Instead, the DoF indices
+ * of the cell are sorted once, and each row of the cell matrix is then
+ * merged into the row of the global matrix in a single walk over it: in a
+ * SparseMatrix, the diagonal comes first and the other columns follow in
+ * increasing order.
+ *
+ * The object only holds scratch arrays, so one object should be reused for
+ * all cells, but not used by several threads at the same time.
+ */
+class BatchedScatter
+{
+public:
+  using size_type = types::global_dof_index;
+
+  template <typename number>
+  void
+  add(const FullMatrix<double> &     cell_matrix,
+      const Vector<double> &         cell_rhs,
+      const std::vector<size_type> &local_dof_indices,
+      SparseMatrix<number> &         matrix,
+      Vector<number> &               rhs);
+
+  /**
+   * The same with constraints. Cells with a constrained DoF go through
+   * AffineConstraints::distribute_local_to_global(), all others take the
+   * batched path, which gives the same result for them.
+   */
+  template <typename number>
+  void
+  add(const FullMatrix<double> &        cell_matrix,
+      const Vector<double> &            cell_rhs,
+      const std::vector<size_type> &    local_dof_indices,
+      const AffineConstraints<double> &constraints,
+      SparseMatrix<number> &            matrix,
+      Vector<number> &                  rhs);
+
+private:
+  std::vector<unsigned int> permutation;
+  std::vector<size_type>    sorted_indices;
+};
+
+
+
+template <typename number>
+void
+BatchedScatter::add(const FullMatrix<double> &     cell_matrix,
+                    const Vector<double> &         cell_rhs,
+                    const std::vector<size_type> &local_dof_indices,
+                    SparseMatrix<number> &         matrix,
+                    Vector<number> &               rhs)
+{
+  const unsigned int n = local_dof_indices.size();
+  AssertDimension(cell_matrix.m(), n);
+  AssertDimension(cell_matrix.n(), n);
+  Assert(matrix.m() == matrix.n(), ExcNotQuadratic());
+
+  permutation.resize(n);
+  std::iota(permutation.begin(), permutation.end(), 0u);
+  std::sort(permutation.begin(),
+            permutation.end(),
+            [&](const unsigned int a, const unsigned int b) {
+              return local_dof_indices[a] < local_dof_indices[b];
+            });
+  sorted_indices.resize(n);
+  for (unsigned int a = 0; a < n; ++a)
+    sorted_indices[a] = local_dof_indices[permutation[a]];
+
+  for (unsigned int a = 0; a < n; ++a)
+    {
+      const unsigned int i   = permutation[a];
+      const size_type    row = sorted_indices[a];
+
+      const auto diagonal = matrix.begin(row);
+      const auto end      = matrix.end(row);
+      auto       entry    = diagonal;
+      for (unsigned int b = 0; b < n; ++b)
+        {
+          const size_type column = sorted_indices[b];
+          const double    value  = cell_matrix(i, permutation[b]);
+          if (column == row)
+            diagonal->value() += value;
+          else
+            {
+              while (entry->column() == row || entry->column() < column)
+                {
+                  ++entry;
+                  Assert(entry != end,
+                         ExcMessage("The entry is not in the sparsity "
+                                    "pattern."));
+                }
+              Assert(entry->column() == column,
+                     ExcMessage("The entry is not in the sparsity pattern."));
+              entry->value() += value;
+            }
+        }
+
+      rhs(row) += cell_rhs(i);
+    }
+}
+
+
+
+template <typename number>
+void
+BatchedScatter::add(const FullMatrix<double> &        cell_matrix,
+                    const Vector<double> &            cell_rhs,
+                    const std::vector<size_type> &    local_dof_indices,
+                    const AffineConstraints<double> &constraints,
+                    SparseMatrix<number> &            matrix,
+                    Vector<number> &                  rhs)
+{
+  for (const size_type dof : local_dof_indices)
+    if (constraints.is_constrained(dof))
+      {
+        constraints.distribute_local_to_global(
+          cell_matrix, cell_rhs, local_dof_indices, matrix, rhs);
+        return;
+      }
+
+  add(cell_matrix, cell_rhs, local_dof_indices, matrix, rhs);
+}
+
+#endif
@@ -0,0 +1,690 @@
+#ifndef bsr_matrix_h
+#define bsr_matrix_h
+
+#include <deal.II/base/memory_consumption.h>
+#include <deal.II/base/parallel.h>
+#include <deal.II/base/smartpointer.h>
+#include <deal.II/base/subscriptor.h>
+
+#include <deal.II/dofs/dof_accessor.h>
+
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/vector.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+using namespace dealii;
+
+
+/**
+ * A block compressed row (BSR) sparsity pattern built from a DoFHandler.
+ * The DoFs are grouped into blocks of DoFs that lie on exactly the same
+ * cells: for FE_Q of degree p in 2d these are the single vertex DoFs, the
+ * p-1 DoFs inside each line and the (p-1)^2 DoFs inside each cell, and for
+ * vector-valued elements all components of a node end up in the same
+ * block. Two DoFs of the same block couple to exactly the same DoFs, so
+ * the pattern only stores one column index per pair of coupled blocks
+ * instead of one per scalar entry.
+ *
+ * The values of a block row form one dense panel, stored column by column,
+ * with the columns of all blocks of the row one after the other. The
+ * position of a block is therefore given by the start of its row and the
+ * sizes of the blocks before it, and nothing but its column is stored per
+ * block. Blocks of one DoF cost as much index memory as a CSR entry, so
+ * the savings start where the blocks get larger: for FE_Q in 2d at degree
+ * 3, where lines have two and cells four inner DoFs, and grow with the
+ * degree.
+ *
+ * reinit() renumbers the DoFs so that each block is a contiguous range,
+ * keeping the blocks in the order of their first DoF.
+ */
+class BSRSparsityPattern : public Subscriptor
+{
+public:
+  using size_type = types::global_dof_index;
+
+  template <typename DoFHandlerType>
+  void
+  reinit(DoFHandlerType &dof_handler);
+
+  size_type
+  n_rows() const;
+
+  unsigned int
+  n_blocks() const;
+
+  /**
+   * The first DoF and the number of DoFs of block @p b.
+   */
+  size_type
+  block_start(const unsigned int b) const;
+
+  unsigned int
+  block_size(const unsigned int b) const;
+
+  unsigned int
+  block_of_dof(const size_type dof) const;
+
+  /**
+   * The position of block (i,j) in the list of stored blocks, or
+   * numbers::invalid_size_type if it is not stored.
+   */
+  std::size_t
+  find(const unsigned int i, const unsigned int j) const;
+
+  /**
+   * The position of the first value of block (i,j), or
+   * numbers::invalid_size_type if it is not stored.
+   */
+  std::size_t
+  value_index(const unsigned int i, const unsigned int j) const;
+
+  /**
+   * Number of stored blocks, and of scalar entries in them.
+   */
+  std::size_t
+  n_nonzero_blocks() const;
+
+  std::size_t
+  n_nonzero_elements() const;
+
+  std::size_t
+  memory_consumption() const;
+
+private:
+  std::vector<size_type>    block_starts;
+  std::vector<unsigned int> dof_to_block;
+
+  std::vector<std::size_t>  row_start;
+  std::vector<unsigned int> block_columns;
+
+  /**
+   * Position of the first value of each block row.
+   */
+  std::vector<std::size_t> row_value_start;
+
+  template <typename number>
+  friend class BSRMatrix;
+};
+
+
+
+/**
+ * A sparse matrix on a BSRSparsityPattern, with a dense block for each pair
+ * of coupled blocks of DoFs. Cell matrices are added one block at a time,
+ * and vmult() multiplies by whole blocks in parallel over the block rows.
+ * The blocks are stored column by column, so that the innermost loop of
+ * vmult() is a contiguous axpy the compiler can vectorize.
+ */
+template <typename number>
+class BSRMatrix : public Subscriptor
+{
+public:
+  using size_type  = types::global_dof_index;
+  using value_type = number;
+
+  void
+  reinit(const BSRSparsityPattern &sparsity_pattern);
+
+  size_type
+  m() const;
+
+  size_type
+  n() const;
+
+  std::size_t
+  memory_consumption() const;
+
+  BSRMatrix &
+  operator=(const double d);
+
+  /**
+   * Add a cell matrix with the global DoF indices @p indices.
+   */
+  template <typename number2>
+  void
+  add(const std::vector<size_type> &indices,
+      const FullMatrix<number2> &   cell_matrix);
+
+  number
+  el(const size_type i, const size_type j) const;
+
+  number
+  diag_element(const size_type i) const;
+
+  template <typename somenumber>
+  void
+  vmult(Vector<somenumber> &dst, const Vector<somenumber> &src) const;
+
+  template <typename somenumber>
+  void
+  precondition_Jacobi(Vector<somenumber> &      dst,
+                      const Vector<somenumber> &src,
+                      const number              omega = 1.) const;
+
+  /**
+   * Impose @p boundary_values like MatrixTools::apply_boundary_values() with
+   * eliminate_columns == true, which keeps a symmetric matrix symmetric.
+   */
+  template <typename somenumber>
+  void
+  apply_boundary_values(
+    const std::map<size_type, somenumber> &boundary_values,
+    Vector<somenumber> &                   solution,
+    Vector<somenumber> &                   right_hand_side);
+
+private:
+  number &
+  entry(const size_type i, const size_type j);
+
+  SmartPointer<const BSRSparsityPattern, BSRMatrix<number>> sparsity_pattern;
+
+  std::vector<number> values;
+
+  /**
+   * The blocks and local indices of the DoFs of the cell in add(), kept
+   * between calls.
+   */
+  std::vector<std::pair<unsigned int, unsigned int>> local_blocks;
+};
+
+
+
+template <typename DoFHandlerType>
+inline void
+BSRSparsityPattern::reinit(DoFHandlerType &dof_handler)
+{
+  const size_type n_dofs = dof_handler.n_dofs();
+
+  // The DoFs of each cell, and the cells of each DoF in the order of the
+  // active cell iterators, both stored CSR-style as offsets into one array.
+  std::vector<std::size_t>  cell_dof_start(1, 0);
+  std::vector<size_type>    cell_dofs;
+  std::vector<std::size_t>  dof_cell_start(n_dofs + 1, 0);
+  std::vector<unsigned int> dof_cells;
+  std::vector<size_type>    local_dof_indices;
+  for (const auto &cell : dof_handler.active_cell_iterators())
+    {
+      local_dof_indices.resize(cell->get_fe().dofs_per_cell);
+      cell->get_dof_indices(local_dof_indices);
+      for (const size_type dof : local_dof_indices)
+        ++dof_cell_start[dof + 1];
+      cell_dofs.insert(cell_dofs.end(),
+                       local_dof_indices.begin(),
+                       local_dof_indices.end());
+      cell_dof_start.push_back(cell_dofs.size());
+    }
+  const unsigned int n_cells = cell_dof_start.size() - 1;
+  for (size_type dof = 0; dof < n_dofs; ++dof)
+    dof_cell_start[dof + 1] += dof_cell_start[dof];
+  dof_cells.resize(dof_cell_start.back());
+  {
+    std::vector<std::size_t> next(dof_cell_start.begin(),
+                                  dof_cell_start.end() - 1);
+    for (unsigned int c = 0; c < n_cells; ++c)
+      for (std::size_t k = cell_dof_start[c]; k < cell_dof_start[c + 1]; ++k)
+        dof_cells[next[cell_dofs[k]]++] = c;
+  }
+
+  // Group the DoFs by their cells, and number the groups by their first DoF.
+  // The groups are looked up by their first DoF, hashed and compared by the
+  // (sorted) list of its cells.
+  const auto hash = [&](const size_type dof) {
+    std::size_t h = 0;
+    for (std::size_t k = dof_cell_start[dof]; k < dof_cell_start[dof + 1]; ++k)
+      h ^= dof_cells[k] + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return h;
+  };
+  const auto same_cells = [&](const size_type a, const size_type b) {
+    return dof_cell_start[a + 1] - dof_cell_start[a] ==
+             dof_cell_start[b + 1] - dof_cell_start[b] &&
+           std::equal(dof_cells.begin() + dof_cell_start[a],
+                      dof_cells.begin() + dof_cell_start[a + 1],
+                      dof_cells.begin() + dof_cell_start[b]);
+  };
+  std::unordered_map<size_type,
+                     unsigned int,
+                     decltype(hash),
+                     decltype(same_cells)>
+                            groups(n_dofs, hash, same_cells);
+  std::vector<unsigned int> group_of_dof(n_dofs);
+  std::vector<unsigned int> group_sizes;
+  std::vector<size_type>    group_first_dof;
+  for (size_type dof = 0; dof < n_dofs; ++dof)
+    {
+      const unsigned int next_group = group_sizes.size();
+      const auto         inserted   = groups.insert({dof, next_group});
+      group_of_dof[dof]             = inserted.first->second;
+      if (inserted.second)
+        {
+          group_sizes.push_back(0);
+          group_first_dof.push_back(dof);
+        }
+      ++group_sizes[group_of_dof[dof]];
+    }
+  groups.clear();
+
+  block_starts.assign(group_sizes.size() + 1, 0);
+  for (unsigned int b = 0; b < group_sizes.size(); ++b)
+    block_starts[b + 1] = block_starts[b] + group_sizes[b];
+
+  std::vector<size_type> new_numbers(n_dofs);
+  {
+    std::vector<size_type> next(block_starts.begin(), block_starts.end() - 1);
+    for (size_type dof = 0; dof < n_dofs; ++dof)
+      new_numbers[dof] = next[group_of_dof[dof]]++;
+  }
+  dof_handler.renumber_dofs(new_numbers);
+
+  dof_to_block.resize(n_dofs);
+  for (size_type dof = 0; dof < n_dofs; ++dof)
+    dof_to_block[new_numbers[dof]] = group_of_dof[dof];
+
+  // Blocks couple if they share a cell. All DoFs of a block lie on the same
+  // cells, so the columns of a block row are the blocks of the DoFs on the
+  // cells of its first DoF.
+  const unsigned int n_blocks = group_sizes.size();
+  row_start.assign(n_blocks + 1, 0);
+  row_value_start.assign(n_blocks + 1, 0);
+  block_columns.clear();
+  std::vector<unsigned int> columns;
+  for (unsigned int b = 0; b < n_blocks; ++b)
+    {
+      const size_type first_dof = group_first_dof[b];
+      columns.assign(1, b);
+      for (std::size_t k = dof_cell_start[first_dof];
+           k < dof_cell_start[first_dof + 1];
+           ++k)
+        for (std::size_t l = cell_dof_start[dof_cells[k]];
+             l < cell_dof_start[dof_cells[k] + 1];
+             ++l)
+          columns.push_back(group_of_dof[cell_dofs[l]]);
+      std::sort(columns.begin(), columns.end());
+      columns.erase(std::unique(columns.begin(), columns.end()),
+                    columns.end());
+      size_type row_width = 0;
+      for (const unsigned int c : columns)
+        {
+          block_columns.push_back(c);
+          row_width += block_size(c);
+        }
+      row_start[b + 1]       = block_columns.size();
+      row_value_start[b + 1] =
+        row_value_start[b] + std::size_t(block_size(b)) * row_width;
+    }
+}
+
+
+
+inline BSRSparsityPattern::size_type
+BSRSparsityPattern::n_rows() const
+{
+  return dof_to_block.size();
+}
+
+
+
+inline unsigned int
+BSRSparsityPattern::n_blocks() const
+{
+  return block_starts.empty() ? 0 : block_starts.size() - 1;
+}
+
+
+
+inline BSRSparsityPattern::size_type
+BSRSparsityPattern::block_start(const unsigned int b) const
+{
+  AssertIndexRange(b, n_blocks());
+  return block_starts[b];
+}
+
+
+
+inline unsigned int
+BSRSparsityPattern::block_size(const unsigned int b) const
+{
+  AssertIndexRange(b, n_blocks());
+  return block_starts[b + 1] - block_starts[b];
+}
+
+
+
+inline unsigned int
+BSRSparsityPattern::block_of_dof(const size_type dof) const
+{
+  AssertIndexRange(dof, n_rows());
+  return dof_to_block[dof];
+}
+
+
+
+inline std::size_t
+BSRSparsityPattern::find(const unsigned int i, const unsigned int j) const
+{
+  const auto begin = block_columns.begin() + row_start[i];
+  const auto end   = block_columns.begin() + row_start[i + 1];
+  const auto p     = std::lower_bound(begin, end, j);
+  return (p != end && *p == j) ? p - block_columns.begin() :
+                                 numbers::invalid_size_type;
+}
+
+
+
+inline std::size_t
+BSRSparsityPattern::value_index(const unsigned int i,
+                                const unsigned int j) const
+{
+  std::size_t index = row_value_start[i];
+  for (std::size_t k = row_start[i]; k < row_start[i + 1]; ++k)
+    {
+      if (block_columns[k] == j)
+        return index;
+      if (block_columns[k] > j)
+        break;
+      index += std::size_t(block_size(i)) * block_size(block_columns[k]);
+    }
+  return numbers::invalid_size_type;
+}
+
+
+
+inline std::size_t
+BSRSparsityPattern::n_nonzero_blocks() const
+{
+  return block_columns.size();
+}
+
+
+
+inline std::size_t
+BSRSparsityPattern::n_nonzero_elements() const
+{
+  return row_value_start.back();
+}
+
+
+
+inline std::size_t
+BSRSparsityPattern::memory_consumption() const
+{
+  return sizeof(*this) + MemoryConsumption::memory_consumption(block_starts) +
+         MemoryConsumption::memory_consumption(dof_to_block) +
+         MemoryConsumption::memory_consumption(row_start) +
+         MemoryConsumption::memory_consumption(block_columns) +
+         MemoryConsumption::memory_consumption(row_value_start);
+}
+
+
+
+template <typename number>
+inline void
+BSRMatrix<number>::reinit(const BSRSparsityPattern &sparsity_pattern)
+{
+  this->sparsity_pattern = &sparsity_pattern;
+  values.assign(sparsity_pattern.n_nonzero_elements(), number());
+}
+
+
+
+template <typename number>
+inline typename BSRMatrix<number>::size_type
+BSRMatrix<number>::m() const
+{
+  return sparsity_pattern->n_rows();
+}
+
+
+
+template <typename number>
+inline typename BSRMatrix<number>::size_type
+BSRMatrix<number>::n() const
+{
+  return sparsity_pattern->n_rows();
+}
+
+
+
+template <typename number>
+inline std::size_t
+BSRMatrix<number>::memory_consumption() const
+{
+  return sizeof(*this) + MemoryConsumption::memory_consumption(values);
+}
+
+
+
+template <typename number>
+inline BSRMatrix<number> &
+BSRMatrix<number>::operator=(const double d)
+{
+  (void)d;
+  Assert(d == 0, ExcScalarAssignmentOnlyForZeroValue());
+  std::fill(values.begin(), values.end(), number());
+  return *this;
+}
+
+
+
+template <typename number>
+template <typename number2>
+inline void
+BSRMatrix<number>::add(const std::vector<size_type> &indices,
+                       const FullMatrix<number2> &   cell_matrix)
+{
+  const BSRSparsityPattern &sp = *sparsity_pattern;
+  AssertDimension(indices.size(), cell_matrix.m());
+  AssertDimension(indices.size(), cell_matrix.n());
+
+  // Sort the local DoFs by block, so that each pair of blocks of the cell
+  // is written as a whole, and the blocks of a row are found in one walk
+  // along it.
+  local_blocks.resize(indices.size());
+  for (unsigned int i = 0; i < indices.size(); ++i)
+    local_blocks[i] = {sp.block_of_dof(indices[i]), i};
+  std::sort(local_blocks.begin(), local_blocks.end());
+  const auto &local = local_blocks;
+
+  for (unsigned int i_begin = 0; i_begin < local.size();)
+    {
+      const unsigned int block_i = local[i_begin].first;
+      unsigned int       i_end   = i_begin;
+      while (i_end < local.size() && local[i_end].first == block_i)
+        ++i_end;
+
+      const unsigned int size_i = sp.block_size(block_i);
+      const size_type    row_0  = sp.block_start(block_i);
+      std::size_t        k      = sp.row_start[block_i];
+      number *           block  = &values[sp.row_value_start[block_i]];
+
+      for (unsigned int j_begin = 0; j_begin < local.size();)
+        {
+          const unsigned int block_j = local[j_begin].first;
+          unsigned int       j_end   = j_begin;
+          while (j_end < local.size() && local[j_end].first == block_j)
+            ++j_end;
+
+          for (; k < sp.row_start[block_i + 1] && sp.block_columns[k] < block_j;
+               ++k)
+            block += size_i * sp.block_size(sp.block_columns[k]);
+          Assert(k < sp.row_start[block_i + 1] &&
+                   sp.block_columns[k] == block_j,
+                 ExcMessage("The block is not in the sparsity pattern."));
+
+          const size_type col_0 = sp.block_start(block_j);
+          for (unsigned int j = j_begin; j < j_end; ++j)
+            {
+              const size_type col = indices[local[j].second] - col_0;
+              for (unsigned int i = i_begin; i < i_end; ++i)
+                block[col * size_i + indices[local[i].second] - row_0] +=
+                  cell_matrix(local[i].second, local[j].second);
+            }
+
+          j_begin = j_end;
+        }
+
+      i_begin = i_end;
+    }
+}
+
+
+
+template <typename number>
+inline number &
+BSRMatrix<number>::entry(const size_type i, const size_type j)
+{
+  const BSRSparsityPattern &sp      = *sparsity_pattern;
+  const unsigned int        block_i = sp.block_of_dof(i);
+  const unsigned int        block_j = sp.block_of_dof(j);
+  const std::size_t         k       = sp.value_index(block_i, block_j);
+  Assert(k != numbers::invalid_size_type,
+         ExcMessage("The entry is not in the sparsity pattern."));
+  return values[k +
+                (j - sp.block_start(block_j)) * sp.block_size(block_i) +
+                (i - sp.block_start(block_i))];
+}
+
+
+
+template <typename number>
+inline number
+BSRMatrix<number>::el(const size_type i, const size_type j) const
+{
+  const BSRSparsityPattern &sp = *sparsity_pattern;
+  if (sp.find(sp.block_of_dof(i), sp.block_of_dof(j)) ==
+      numbers::invalid_size_type)
+    return number();
+  return const_cast<BSRMatrix<number> *>(this)->entry(i, j);
+}
+
+
+
+template <typename number>
+inline number
+BSRMatrix<number>::diag_element(const size_type i) const
+{
+  return const_cast<BSRMatrix<number> *>(this)->entry(i, i);
+}
+
+
+
+template <typename number>
+template <typename somenumber>
+inline void
+BSRMatrix<number>::vmult(Vector<somenumber> &      dst,
+                         const Vector<somenumber> &src) const
+{
+  const BSRSparsityPattern &sp = *sparsity_pattern;
+  AssertDimension(dst.size(), sp.n_rows());
+  AssertDimension(src.size(), sp.n_rows());
+
+  parallel::apply_to_subranges(
+    0u,
+    sp.n_blocks(),
+    [&](const unsigned int begin, const unsigned int end) {
+      for (unsigned int block_i = begin; block_i < end; ++block_i)
+        {
+          const unsigned int size_i = sp.block_size(block_i);
+          somenumber *       y      = dst.begin() + sp.block_start(block_i);
+          const number *     a      = &values[sp.row_value_start[block_i]];
+          std::fill(y, y + size_i, somenumber());
+
+          for (std::size_t k = sp.row_start[block_i];
+               k < sp.row_start[block_i + 1];
+               ++k)
+            {
+              const unsigned int block_j = sp.block_columns[k];
+              const unsigned int size_j  = sp.block_size(block_j);
+              const somenumber * x = src.begin() + sp.block_start(block_j);
+              for (unsigned int j = 0; j < size_j; ++j, a += size_i)
+                {
+                  const somenumber x_j = x[j];
+                  DEAL_II_OPENMP_SIMD_PRAGMA
+                  for (unsigned int i = 0; i < size_i; ++i)
+                    y[i] += a[i] * x_j;
+                }
+            }
+        }
+    },
+    256);
+}
+
+
+
+template <typename number>
+template <typename somenumber>
+inline void
+BSRMatrix<number>::precondition_Jacobi(Vector<somenumber> &      dst,
+                                       const Vector<somenumber> &src,
+                                       const number              omega) const
+{
+  AssertDimension(dst.size(), m());
+  AssertDimension(src.size(), m());
+  for (size_type i = 0; i < m(); ++i)
+    dst(i) = omega * src(i) / diag_element(i);
+}
+
+
+
+template <typename number>
+template <typename somenumber>
+inline void
+BSRMatrix<number>::apply_boundary_values(
+  const std::map<size_type, somenumber> &boundary_values,
+  Vector<somenumber> &                   solution,
+  Vector<somenumber> &                   right_hand_side)
+{
+  if (boundary_values.empty())
+    return;
+
+  const BSRSparsityPattern &sp = *sparsity_pattern;
+
+  // A diagonal entry for rows whose own diagonal is zero.
+  number first_nonzero_diagonal = 1.;
+  for (size_type i = 0; i < m(); ++i)
+    if (diag_element(i) != number())
+      {
+        first_nonzero_diagonal = std::abs(diag_element(i));
+        break;
+      }
+
+  for (const auto &boundary_value : boundary_values)
+    {
+      const size_type    dof     = boundary_value.first;
+      const unsigned int block_k = sp.block_of_dof(dof);
+
+      number &diagonal = entry(dof, dof);
+      if (diagonal == number())
+        diagonal = first_nonzero_diagonal;
+      const number d = diagonal;
+
+      // Zero the row and the column of the DoF, moving the column to the
+      // right hand side. The blocks coupling to block_k in its row are the
+      // same as in its column, since the pattern is symmetric.
+      for (std::size_t k = sp.row_start[block_k]; k < sp.row_start[block_k + 1];
+           ++k)
+        {
+          const unsigned int block_j = sp.block_columns[k];
+          for (size_type j = sp.block_start(block_j);
+               j < sp.block_start(block_j) + sp.block_size(block_j);
+               ++j)
+            if (j != dof)
+              {
+                entry(dof, j) = number();
+                number &a_jk  = entry(j, dof);
+                if (boundary_values.find(j) == boundary_values.end())
+                  right_hand_side(j) -= a_jk * boundary_value.second;
+                a_jk = number();
+              }
+        }
+
+      right_hand_side(dof) = d * boundary_value.second;
+      solution(dof)        = boundary_value.second;
+    }
+}
+
+#endif
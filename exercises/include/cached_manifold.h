@@ -0,0 +1,422 @@
+#ifndef cached_manifold_h
+#define cached_manifold_h
+
+#include <deal.II/base/array_view.h>
+#include <deal.II/base/geometry_info.h>
+#include <deal.II/base/parallel.h>
+#include <deal.II/base/point.h>
+#include <deal.II/base/table.h>
+
+#include <deal.II/grid/manifold.h>
+#include <deal.II/grid/tria.h>
+#include <deal.II/grid/tria_accessor.h>
+#include <deal.II/grid/tria_iterator.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+using namespace dealii;
+
+
+/**
+ * A Manifold that memoizes the new points computed by another one.
+ *
+ * Requests are keyed by the exact bit patterns of the surrounding points
+ * and weights, and by the function that was called, so that every answer
+ * is the one the wrapped manifold would have given: meshes refined with
+ * and without the cache are bit-identical.
+ *
+ * Triangulations store clones of their manifolds. All clones of a
+ * CachedManifold share the same cache, so the object the user holds can be
+ * used to query the statistics, or to clear() the cache once its entries
+ * are not needed any more.
+ *
+ * Together with prefetch_refinement_points(), which computes the new points
+ * of a refinement pass in parallel before the (serial) refinement itself,
+ * this moves the manifold evaluations off the critical path of
+ * Triangulation::execute_coarsening_and_refinement().
+ */
+template <int dim, int spacedim = dim>
+class CachedManifold : public Manifold<dim, spacedim>
+{
+public:
+  CachedManifold(const Manifold<dim, spacedim> &manifold);
+
+  CachedManifold(const CachedManifold<dim, spacedim> &other);
+
+  virtual std::unique_ptr<Manifold<dim, spacedim>>
+  clone() const override;
+
+  virtual Point<spacedim>
+  get_intermediate_point(const Point<spacedim> &p1,
+                         const Point<spacedim> &p2,
+                         const double           w) const override;
+
+  virtual Point<spacedim>
+  get_new_point(const ArrayView<const Point<spacedim>> &surrounding_points,
+                const ArrayView<const double> &         weights) const override;
+
+  /**
+   * Look up every row of @p weights in the cache, and compute all missing
+   * points with a single call to the get_new_points() function of the
+   * wrapped manifold, which for most manifolds is vectorized over the
+   * rows.
+   */
+  virtual void
+  get_new_points(const ArrayView<const Point<spacedim>> &surrounding_points,
+                 const Table<2, double> &                weights,
+                 ArrayView<Point<spacedim>> new_points) const override;
+
+  virtual Point<spacedim>
+  project_to_manifold(
+    const ArrayView<const Point<spacedim>> &surrounding_points,
+    const Point<spacedim> &                 candidate) const override;
+
+  virtual Tensor<1, spacedim>
+  get_tangent_vector(const Point<spacedim> &x1,
+                     const Point<spacedim> &x2) const override;
+
+  void
+  clear() const;
+
+  std::size_t
+  n_hits() const;
+
+  std::size_t
+  n_misses() const;
+
+private:
+  using Key = std::vector<double>;
+
+  struct KeyHash
+  {
+    std::size_t
+    operator()(const Key &key) const;
+  };
+
+  struct Cache
+  {
+    std::mutex                                        mutex;
+    std::unordered_map<Key, Point<spacedim>, KeyHash> points;
+    std::size_t                                       n_hits   = 0;
+    std::size_t                                       n_misses = 0;
+  };
+
+  /**
+   * Identifies which function of the wrapped manifold computed a point:
+   * different code paths need not agree to the last bit.
+   */
+  enum Request
+  {
+    intermediate_point_request,
+    new_point_request,
+    new_points_request
+  };
+
+  static Key
+  make_key(const Request                           request,
+           const ArrayView<const Point<spacedim>> &surrounding_points,
+           const ArrayView<const double> &         weights);
+
+  bool
+  lookup(const Key &key, Point<spacedim> &point) const;
+
+  void
+  store(Key &&key, const Point<spacedim> &point) const;
+
+  const std::shared_ptr<const Manifold<dim, spacedim>> manifold;
+  const std::shared_ptr<Cache>                         cache;
+};
+
+
+
+/**
+ * Compute, in parallel, the new points that the next call to
+ * execute_coarsening_and_refinement() will ask the manifolds of
+ * @p triangulation for: the midpoints of the lines, faces and cells of all
+ * cells flagged for isotropic refinement. The results only survive in the
+ * caches of CachedManifold objects; for other manifolds this function only
+ * costs time.
+ */
+template <int dim, int spacedim>
+void
+prefetch_refinement_points(const Triangulation<dim, spacedim> &triangulation);
+
+
+
+template <int dim, int spacedim>
+CachedManifold<dim, spacedim>::CachedManifold(
+  const Manifold<dim, spacedim> &manifold)
+  : manifold(manifold.clone())
+  , cache(std::make_shared<Cache>())
+{}
+
+
+
+template <int dim, int spacedim>
+CachedManifold<dim, spacedim>::CachedManifold(
+  const CachedManifold<dim, spacedim> &other)
+  : Manifold<dim, spacedim>()
+  , manifold(other.manifold)
+  , cache(other.cache)
+{}
+
+
+
+template <int dim, int spacedim>
+std::unique_ptr<Manifold<dim, spacedim>>
+CachedManifold<dim, spacedim>::clone() const
+{
+  return std::unique_ptr<Manifold<dim, spacedim>>(
+    new CachedManifold<dim, spacedim>(*this));
+}
+
+
+
+template <int dim, int spacedim>
+std::size_t
+CachedManifold<dim, spacedim>::KeyHash::operator()(const Key &key) const
+{
+  std::uint64_t h = 14695981039346656037ull;
+  for (const double value : key)
+    {
+      std::uint64_t bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      h ^= bits;
+      h *= 1099511628211ull;
+    }
+  return h;
+}
+
+
+
+template <int dim, int spacedim>
+typename CachedManifold<dim, spacedim>::Key
+CachedManifold<dim, spacedim>::make_key(
+  const Request                           request,
+  const ArrayView<const Point<spacedim>> &surrounding_points,
+  const ArrayView<const double> &         weights)
+{
+  Key key;
+  key.reserve(1 + surrounding_points.size() * spacedim + weights.size());
+  key.push_back(request);
+  for (const auto &p : surrounding_points)
+    for (unsigned int d = 0; d < spacedim; ++d)
+      key.push_back(p[d]);
+  key.insert(key.end(), weights.begin(), weights.end());
+  return key;
+}
+
+
+
+template <int dim, int spacedim>
+bool
+CachedManifold<dim, spacedim>::lookup(const Key &      key,
+                                      Point<spacedim> &point) const
+{
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  const auto                  entry = cache->points.find(key);
+  if (entry == cache->points.end())
+    {
+      ++cache->n_misses;
+      return false;
+    }
+  ++cache->n_hits;
+  point = entry->second;
+  return true;
+}
+
+
+
+template <int dim, int spacedim>
+void
+CachedManifold<dim, spacedim>::store(Key &&                 key,
+                                     const Point<spacedim> &point) const
+{
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  cache->points.emplace(std::move(key), point);
+}
+
+
+
+template <int dim, int spacedim>
+Point<spacedim>
+CachedManifold<dim, spacedim>::get_intermediate_point(
+  const Point<spacedim> &p1,
+  const Point<spacedim> &p2,
+  const double           w) const
+{
+  const Point<spacedim> points[2]  = {p1, p2};
+  const double          weights[1] = {w};
+
+  Key key = make_key(intermediate_point_request,
+                     make_array_view(points),
+                     make_array_view(weights));
+
+  Point<spacedim> point;
+  if (!lookup(key, point))
+    {
+      point = manifold->get_intermediate_point(p1, p2, w);
+      store(std::move(key), point);
+    }
+  return point;
+}
+
+
+
+template <int dim, int spacedim>
+Point<spacedim>
+CachedManifold<dim, spacedim>::get_new_point(
+  const ArrayView<const Point<spacedim>> &surrounding_points,
+  const ArrayView<const double> &         weights) const
+{
+  Key key = make_key(new_point_request, surrounding_points, weights);
+
+  Point<spacedim> point;
+  if (!lookup(key, point))
+    {
+      point = manifold->get_new_point(surrounding_points, weights);
+      store(std::move(key), point);
+    }
+  return point;
+}
+
+
+
+template <int dim, int spacedim>
+void
+CachedManifold<dim, spacedim>::get_new_points(
+  const ArrayView<const Point<spacedim>> &surrounding_points,
+  const Table<2, double> &                weights,
+  ArrayView<Point<spacedim>>              new_points) const
+{
+  const unsigned int n_rows   = weights.size(0);
+  const unsigned int n_points = weights.size(1);
+
+  std::vector<Key>          keys(n_rows);
+  std::vector<unsigned int> missing;
+  for (unsigned int row = 0; row < n_rows; ++row)
+    {
+      keys[row] = make_key(new_points_request,
+                           surrounding_points,
+                           make_array_view(&weights(row, 0),
+                                           &weights(row, 0) + n_points));
+      if (!lookup(keys[row], new_points[row]))
+        missing.push_back(row);
+    }
+
+  if (missing.empty())
+    return;
+
+  Table<2, double> missing_weights(missing.size(), n_points);
+  for (unsigned int i = 0; i < missing.size(); ++i)
+    for (unsigned int j = 0; j < n_points; ++j)
+      missing_weights(i, j) = weights(missing[i], j);
+
+  std::vector<Point<spacedim>> missing_points(missing.size());
+  manifold->get_new_points(surrounding_points,
+                           missing_weights,
+                           make_array_view(missing_points));
+
+  for (unsigned int i = 0; i < missing.size(); ++i)
+    {
+      new_points[missing[i]] = missing_points[i];
+      store(std::move(keys[missing[i]]), missing_points[i]);
+    }
+}
+
+
+
+template <int dim, int spacedim>
+Point<spacedim>
+CachedManifold<dim, spacedim>::project_to_manifold(
+  const ArrayView<const Point<spacedim>> &surrounding_points,
+  const Point<spacedim> &                 candidate) const
+{
+  return manifold->project_to_manifold(surrounding_points, candidate);
+}
+
+
+
+template <int dim, int spacedim>
+Tensor<1, spacedim>
+CachedManifold<dim, spacedim>::get_tangent_vector(
+  const Point<spacedim> &x1,
+  const Point<spacedim> &x2) const
+{
+  return manifold->get_tangent_vector(x1, x2);
+}
+
+
+
+template <int dim, int spacedim>
+void
+CachedManifold<dim, spacedim>::clear() const
+{
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  cache->points.clear();
+}
+
+
+
+template <int dim, int spacedim>
+std::size_t
+CachedManifold<dim, spacedim>::n_hits() const
+{
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  return cache->n_hits;
+}
+
+
+
+template <int dim, int spacedim>
+std::size_t
+CachedManifold<dim, spacedim>::n_misses() const
+{
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  return cache->n_misses;
+}
+
+
+
+template <int dim, int spacedim>
+void
+prefetch_refinement_points(const Triangulation<dim, spacedim> &triangulation)
+{
+  std::vector<typename Triangulation<dim, spacedim>::active_cell_iterator>
+    cells;
+  for (const auto &cell : triangulation.active_cell_iterators())
+    if (cell->refine_flag_set() == RefinementCase<dim>::isotropic_refinement)
+      cells.push_back(cell);
+
+  // The refinement computes the midpoints of lines and faces once for each
+  // of them; here neighboring cells may ask for the same ones twice, which
+  // the caches absorb.
+  parallel::apply_to_subranges(
+    0u,
+    static_cast<unsigned int>(cells.size()),
+    [&](const unsigned int begin, const unsigned int end) {
+      for (unsigned int i = begin; i < end; ++i)
+        {
+          const auto &cell = cells[i];
+          if (dim > 1)
+            for (unsigned int l = 0; l < GeometryInfo<dim>::lines_per_cell;
+                 ++l)
+              if (!cell->line(l)->has_children())
+                cell->line(l)->center(true);
+          if (dim > 2)
+            for (unsigned int f = 0; f < GeometryInfo<dim>::faces_per_cell;
+                 ++f)
+              if (!cell->face(f)->has_children())
+                cell->face(f)->center(true, true);
+          cell->center(true, true);
+        }
+    },
+    32);
+}
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef cell_matrix_cache_h
+#define cell_matrix_cache_h
+
+#include <deal.II/base/geometry_info.h>
+#include <deal.II/base/point.h>
+#include <deal.II/base/types.h>
+
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/vector.h>
+
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+using namespace dealii;
+
+
+/**
+ * A cache of the cell matrices and right hand sides of a Laplace problem
+ * with constant right hand side, for cells that differ only by a
+ * translation and a scaling.
+ *
+ * A cell is described by the offsets of its vertices from its first vertex,
+ * divided by the length of its first edge and rounded to a multiple of the
+ * tolerance. Cells with the same description are similar, and with a
+ * mapping that only sees the vertices, their stiffness matrices differ by
+ * the factor $s^{dim-2}$ and their right hand sides by $s^{dim}$, where $s$
+ * is the ratio of their sizes. On a uniformly refined hyper_cube, all cells
+ * of a level share one entry.
+ *
+ * Cells with a curved manifold are never looked up or stored, and neither
+ * are new shapes once the cache holds @p max_n_entries of them, so that a
+ * distorted mesh does not fill the memory with matrices that are used only
+ * once.
+ */
+template <int dim>
+class CellMatrixCache
+{
+public:
+  CellMatrixCache(const unsigned int max_n_entries = 64,
+                  const double       tolerance     = 1e-10);
+
+  /**
+   * If a cell similar to @p cell was stored, write its scaled matrix and
+   * right hand side into @p cell_matrix and @p cell_rhs and return true.
+   * Otherwise return false and leave the arguments untouched.
+   */
+  template <typename CellIterator>
+  bool
+  lookup(const CellIterator &cell,
+         FullMatrix<double> &cell_matrix,
+         Vector<double> &    cell_rhs);
+
+  /**
+   * Remember the matrix and right hand side computed on @p cell.
+   */
+  template <typename CellIterator>
+  void
+  store(const CellIterator &      cell,
+        const FullMatrix<double> &cell_matrix,
+        const Vector<double> &    cell_rhs);
+
+  void
+  clear();
+
+  unsigned int
+  n_entries() const;
+
+  unsigned int
+  n_hits() const;
+
+  unsigned int
+  n_misses() const;
+
+private:
+  using Key = std::vector<std::int64_t>;
+
+  struct Entry
+  {
+    double             size;
+    FullMatrix<double> matrix;
+    Vector<double>     rhs;
+  };
+
+  /**
+   * Fill @p key and @p size for @p cell. Returns false if the cell is
+   * curved, in which case it cannot be cached.
+   */
+  template <typename CellIterator>
+  bool
+  compute_key(const CellIterator &cell, Key &key, double &size) const;
+
+  const unsigned int max_n_entries;
+  const double       tolerance;
+
+  std::map<Key, Entry> entries;
+
+  unsigned int hits;
+  unsigned int misses;
+
+  // Scratch space for the key of the last cell.
+  Key key;
+};
+
+
+
+template <int dim>
+CellMatrixCache<dim>::CellMatrixCache(const unsigned int max_n_entries,
+                                      const double       tolerance)
+  : max_n_entries(max_n_entries)
+  , tolerance(tolerance)
+  , hits(0)
+  , misses(0)
+{}
+
+
+
+template <int dim>
+template <typename CellIterator>
+bool
+CellMatrixCache<dim>::compute_key(const CellIterator &cell,
+                                  Key &               key,
+                                  double &            size) const
+{
+  if (cell->manifold_id() != numbers::flat_manifold_id)
+    return false;
+
+  const Point<dim> origin = cell->vertex(0);
+  size                    = cell->vertex(1).distance(origin);
+
+  key.resize((GeometryInfo<dim>::vertices_per_cell - 1) * dim);
+  for (unsigned int v = 1; v < GeometryInfo<dim>::vertices_per_cell; ++v)
+    for (unsigned int d = 0; d < dim; ++d)
+      key[(v - 1) * dim + d] = static_cast<std::int64_t>(
+        std::round((cell->vertex(v)[d] - origin[d]) / size / tolerance));
+  return true;
+}
+
+
+
+template <int dim>
+template <typename CellIterator>
+bool
+CellMatrixCache<dim>::lookup(const CellIterator &cell,
+                             FullMatrix<double> &cell_matrix,
+                             Vector<double> &    cell_rhs)
+{
+  double size;
+  if (!compute_key(cell, key, size))
+    {
+      ++misses;
+      return false;
+    }
+
+  const auto entry = entries.find(key);
+  if (entry == entries.end())
+    {
+      ++misses;
+      return false;
+    }
+
+  const double scaling = size / entry->second.size;
+
+  cell_matrix = entry->second.matrix;
+  cell_matrix *= std::pow(scaling, dim - 2);
+  cell_rhs = entry->second.rhs;
+  cell_rhs *= std::pow(scaling, dim);
+
+  ++hits;
+  return true;
+}
+
+
+
+template <int dim>
+template <typename CellIterator>
+void
+CellMatrixCache<dim>::store(const CellIterator &      cell,
+                            const FullMatrix<double> &cell_matrix,
+                            const Vector<double> &    cell_rhs)
+{
+  if (entries.size() >= max_n_entries)
+    return;
+
+  double size;
+  if (compute_key(cell, key, size))
+    entries[key] = Entry{size, cell_matrix, cell_rhs};
+}
+
+
+
+template <int dim>
+void
+CellMatrixCache<dim>::clear()
+{
+  entries.clear();
+  hits   = 0;
+  misses = 0;
+}
+
+
+
+template <int dim>
+unsigned int
+CellMatrixCache<dim>::n_entries() const
+{
+  return entries.size();
+}
+
+
+
+template <int dim>
+unsigned int
+CellMatrixCache<dim>::n_hits() const
+{
+  return hits;
+}
+
+
+
+template <int dim>
+unsigned int
+CellMatrixCache<dim>::n_misses() const
+{
+  return misses;
+}
+
+#endif
@@ -0,0 +1,410 @@
+#ifndef hdf5_xdmf_writer_h
+#define hdf5_xdmf_writer_h
+
+#include <deal.II/base/config.h>
+
+#ifdef DEAL_II_WITH_HDF5
+
+#  include <deal.II/base/exceptions.h>
+#  include <deal.II/base/geometry_info.h>
+#  include <deal.II/base/smartpointer.h>
+
+#  include <deal.II/dofs/dof_accessor.h>
+#  include <deal.II/dofs/dof_handler.h>
+
+#  include <deal.II/grid/tria.h>
+
+#  include <deal.II/lac/vector.h>
+
+#  include <boost/signals2/connection.hpp>
+
+#  include <hdf5.h>
+
+#  include <algorithm>
+#  include <fstream>
+#  include <functional>
+#  include <string>
+#  include <vector>
+
+using namespace dealii;
+
+
+/**
+ * A time series of solutions and cell data in one HDF5 file, with an XDMF
+ * file that describes it to ParaView or VisIt.
+ *
+ * Every call to write() appends the current data vectors as a new time
+ * step. The mesh, i.e. the vertices of the triangulation and the vertex
+ * indices of the active cells, is only written when the triangulation has
+ * changed since the last call, so later steps on the same mesh add nothing
+ * but their field data. DoF data are written at the vertices, which for
+ * FE_Q are its vertex DoFs; higher order DoFs are not written.
+ *
+ * The fields are stored as 32 or 64 bit floats, and can be compressed with
+ * deflate, at the given level from 1 to 9. The XDMF file
+ * @p basename.xdmf is rewritten after every step and can be opened while
+ * the program is running.
+ */
+template <int dim>
+class HDF5XDMFWriter
+{
+public:
+  enum class Precision
+  {
+    float32,
+    float64
+  };
+
+  HDF5XDMFWriter(const DoFHandler<dim> &dof_handler,
+                 const std::string &    basename,
+                 const Precision        precision = Precision::float64,
+                 const unsigned int     compression_level = 0);
+
+  ~HDF5XDMFWriter();
+
+  /**
+   * Add a vector with one entry per DoF or one per active cell. Like with
+   * DataOut, the vector has to live until write() is called.
+   */
+  template <typename number>
+  void
+  add_data_vector(const Vector<number> &vector, const std::string &name);
+
+  void
+  clear_data_vectors();
+
+  /**
+   * Write the current data vectors as the step at @p time, preceded by the
+   * mesh if it has changed.
+   */
+  void
+  write(const double time);
+
+private:
+  struct DataVector
+  {
+    std::string                                    name;
+    bool                                           is_cell_data;
+    std::function<double(types::global_dof_index)> value;
+  };
+
+  struct Mesh
+  {
+    unsigned int n_nodes;
+    unsigned int n_cells;
+  };
+
+  struct Step
+  {
+    double                                    time;
+    unsigned int                              mesh;
+    std::vector<std::pair<std::string, bool>> fields;
+  };
+
+  void
+  write_mesh();
+
+  template <typename T>
+  void
+  write_dataset(const std::string &   path,
+                const hid_t           memory_type,
+                const hid_t           file_type,
+                const std::vector<T> &data,
+                const hsize_t         n_columns);
+
+  void
+  write_xdmf() const;
+
+  SmartPointer<const DoFHandler<dim>> dof_handler;
+  const std::string                   basename;
+  const Precision                     precision;
+  const unsigned int                  compression_level;
+
+  hid_t file;
+
+  bool              mesh_changed;
+  std::vector<Mesh> meshes;
+  std::vector<Step> steps;
+
+  std::vector<DataVector> data_vectors;
+
+  boost::signals2::connection mesh_change_connection;
+};
+
+
+
+template <int dim>
+HDF5XDMFWriter<dim>::HDF5XDMFWriter(const DoFHandler<dim> &dof_handler,
+                                    const std::string &    basename,
+                                    const Precision        precision,
+                                    const unsigned int     compression_level)
+  : dof_handler(&dof_handler)
+  , basename(basename)
+  , precision(precision)
+  , compression_level(compression_level)
+  , mesh_changed(true)
+{
+  Assert(compression_level <= 9, ExcIndexRange(compression_level, 0, 10));
+
+  file = H5Fcreate(
+    (basename + ".h5").c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+  AssertThrow(file >= 0, ExcMessage("Could not create " + basename + ".h5"));
+
+  mesh_change_connection =
+    dof_handler.get_triangulation().signals.any_change.connect(
+      [this]() { mesh_changed = true; });
+}
+
+
+
+template <int dim>
+HDF5XDMFWriter<dim>::~HDF5XDMFWriter()
+{
+  mesh_change_connection.disconnect();
+  H5Fclose(file);
+}
+
+
+
+template <int dim>
+template <typename number>
+void
+HDF5XDMFWriter<dim>::add_data_vector(const Vector<number> &vector,
+                                     const std::string &   name)
+{
+  const bool is_cell_data = (vector.size() != dof_handler->n_dofs());
+  Assert(!is_cell_data ||
+           vector.size() ==
+             dof_handler->get_triangulation().n_active_cells(),
+         ExcMessage("The vector has neither one entry per DoF nor one per "
+                    "active cell."));
+
+  data_vectors.push_back(
+    {name, is_cell_data, [&vector](const types::global_dof_index i) {
+       return static_cast<double>(vector(i));
+     }});
+}
+
+
+
+template <int dim>
+void
+HDF5XDMFWriter<dim>::clear_data_vectors()
+{
+  data_vectors.clear();
+}
+
+
+
+template <int dim>
+template <typename T>
+void
+HDF5XDMFWriter<dim>::write_dataset(const std::string &   path,
+                                   const hid_t           memory_type,
+                                   const hid_t           file_type,
+                                   const std::vector<T> &data,
+                                   const hsize_t         n_columns)
+{
+  const hsize_t dimensions[2] = {data.size() / n_columns, n_columns};
+  const hid_t   space         = H5Screate_simple(2, dimensions, nullptr);
+
+  // Intermediate groups, such as the one of the step, are created on the
+  // fly.
+  const hid_t link_properties = H5Pcreate(H5P_LINK_CREATE);
+  H5Pset_create_intermediate_group(link_properties, 1);
+
+  const hid_t dataset_properties = H5Pcreate(H5P_DATASET_CREATE);
+  if (compression_level > 0 && dimensions[0] > 0)
+    {
+      const hsize_t chunk[2] = {std::min<hsize_t>(dimensions[0], 1 << 16),
+                                n_columns};
+      H5Pset_chunk(dataset_properties, 2, chunk);
+      H5Pset_deflate(dataset_properties, compression_level);
+    }
+
+  const hid_t dataset = H5Dcreate2(file,
+                                   path.c_str(),
+                                   file_type,
+                                   space,
+                                   link_properties,
+                                   dataset_properties,
+                                   H5P_DEFAULT);
+  AssertThrow(dataset >= 0, ExcMessage("Could not create " + path));
+
+  const herr_t status = H5Dwrite(
+    dataset, memory_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, data.data());
+  AssertThrow(status >= 0, ExcMessage("Could not write " + path));
+
+  H5Dclose(dataset);
+  H5Pclose(dataset_properties);
+  H5Pclose(link_properties);
+  H5Sclose(space);
+}
+
+
+
+template <int dim>
+void
+HDF5XDMFWriter<dim>::write_mesh()
+{
+  const Triangulation<dim> &triangulation = dof_handler->get_triangulation();
+  const std::vector<Point<dim>> &vertices = triangulation.get_vertices();
+
+  // The nodes always have three coordinates, which XDMF reads for any dim.
+  std::vector<double> nodes(3 * vertices.size(), 0.);
+  for (unsigned int v = 0; v < vertices.size(); ++v)
+    for (unsigned int d = 0; d < dim; ++d)
+      nodes[3 * v + d] = vertices[v][d];
+
+  // XDMF numbers the vertices of quadrilaterals and hexahedra
+  // counterclockwise, deal.II lexicographically.
+  const unsigned int xdmf_to_deal[8] = {0, 1, 3, 2, 4, 5, 7, 6};
+  const unsigned int n_vertices      = GeometryInfo<dim>::vertices_per_cell;
+
+  std::vector<unsigned int> cells;
+  cells.reserve(triangulation.n_active_cells() * n_vertices);
+  for (const auto &cell : triangulation.active_cell_iterators())
+    for (unsigned int v = 0; v < n_vertices; ++v)
+      cells.push_back(cell->vertex_index(dim == 1 ? v : xdmf_to_deal[v]));
+
+  const std::string group = "/mesh_" + std::to_string(meshes.size());
+  write_dataset(group + "/nodes", H5T_NATIVE_DOUBLE, H5T_IEEE_F64LE, nodes, 3);
+  write_dataset(
+    group + "/cells", H5T_NATIVE_UINT, H5T_STD_U32LE, cells, n_vertices);
+
+  meshes.push_back({static_cast<unsigned int>(vertices.size()),
+                    triangulation.n_active_cells()});
+}
+
+
+
+template <int dim>
+void
+HDF5XDMFWriter<dim>::write(const double time)
+{
+  if (mesh_changed)
+    {
+      write_mesh();
+      mesh_changed = false;
+    }
+
+  const Triangulation<dim> &triangulation = dof_handler->get_triangulation();
+
+  // The DoF numbering may change without the mesh, so the DoF of each
+  // vertex is looked up anew.
+  std::vector<types::global_dof_index> vertex_dofs(
+    triangulation.n_vertices(), numbers::invalid_dof_index);
+  for (const auto &cell : dof_handler->active_cell_iterators())
+    for (unsigned int v = 0; v < GeometryInfo<dim>::vertices_per_cell; ++v)
+      vertex_dofs[cell->vertex_index(v)] = cell->vertex_dof_index(v, 0);
+
+  Step step;
+  step.time = time;
+  step.mesh = meshes.size() - 1;
+
+  const std::string group = "/step_" + std::to_string(steps.size());
+  const hid_t       file_type =
+    (precision == Precision::float32 ? H5T_IEEE_F32LE : H5T_IEEE_F64LE);
+
+  std::vector<double> values;
+  for (const auto &data_vector : data_vectors)
+    {
+      if (data_vector.is_cell_data)
+        {
+          values.resize(triangulation.n_active_cells());
+          for (unsigned int c = 0; c < values.size(); ++c)
+            values[c] = data_vector.value(c);
+        }
+      else
+        {
+          values.assign(vertex_dofs.size(), 0.);
+          for (unsigned int v = 0; v < vertex_dofs.size(); ++v)
+            if (vertex_dofs[v] != numbers::invalid_dof_index)
+              values[v] = data_vector.value(vertex_dofs[v]);
+        }
+
+      // HDF5 converts the values to the precision of the file.
+      write_dataset(group + "/" + data_vector.name,
+                    H5T_NATIVE_DOUBLE,
+                    file_type,
+                    values,
+                    1);
+      step.fields.emplace_back(data_vector.name, data_vector.is_cell_data);
+    }
+
+  steps.push_back(step);
+
+  H5Fflush(file, H5F_SCOPE_GLOBAL);
+  write_xdmf();
+}
+
+
+
+template <int dim>
+void
+HDF5XDMFWriter<dim>::write_xdmf() const
+{
+  // The XDMF file lies next to the HDF5 file and refers to it by name.
+  const std::string h5_name =
+    basename.substr(basename.find_last_of('/') + 1) + ".h5";
+  const char *topology_types[] = {"",
+                                  "Polyline",
+                                  "Quadrilateral",
+                                  "Hexahedron"};
+  const unsigned int n_vertices = GeometryInfo<dim>::vertices_per_cell;
+  const std::string  field_precision =
+    (precision == Precision::float32 ? "4" : "8");
+
+  std::ofstream out(basename + ".xdmf");
+  out << "<?xml version=\"1.0\" ?>\n"
+      << "<!DOCTYPE Xdmf SYSTEM \"Xdmf.dtd\" []>\n"
+      << "<Xdmf Version=\"2.0\">\n"
+      << "  <Domain>\n"
+      << "    <Grid Name=\"TimeSeries\" GridType=\"Collection\" "
+      << "CollectionType=\"Temporal\">\n";
+
+  for (unsigned int s = 0; s < steps.size(); ++s)
+    {
+      const Step &      step = steps[s];
+      const Mesh &      mesh = meshes[step.mesh];
+      const std::string mesh_group =
+        h5_name + ":/mesh_" + std::to_string(step.mesh);
+
+      out << "      <Grid Name=\"step_" << s << "\" GridType=\"Uniform\">\n"
+          << "        <Time Value=\"" << step.time << "\"/>\n"
+          << "        <Geometry GeometryType=\"XYZ\">\n"
+          << "          <DataItem Dimensions=\"" << mesh.n_nodes
+          << " 3\" NumberType=\"Float\" Precision=\"8\" Format=\"HDF\">"
+          << mesh_group << "/nodes</DataItem>\n"
+          << "        </Geometry>\n"
+          << "        <Topology TopologyType=\"" << topology_types[dim]
+          << "\" NumberOfElements=\"" << mesh.n_cells << "\""
+          << (dim == 1 ? " NodesPerElement=\"2\"" : "") << ">\n"
+          << "          <DataItem Dimensions=\"" << mesh.n_cells << " "
+          << n_vertices
+          << "\" NumberType=\"UInt\" Precision=\"4\" Format=\"HDF\">"
+          << mesh_group << "/cells</DataItem>\n"
+          << "        </Topology>\n";
+
+      for (const auto &field : step.fields)
+        out << "        <Attribute Name=\"" << field.first
+            << "\" AttributeType=\"Scalar\" Center=\""
+            << (field.second ? "Cell" : "Node") << "\">\n"
+            << "          <DataItem Dimensions=\""
+            << (field.second ? mesh.n_cells : mesh.n_nodes)
+            << " 1\" NumberType=\"Float\" Precision=\"" << field_precision
+            << "\" Format=\"HDF\">" << h5_name << ":/step_" << s << "/"
+            << field.first << "</DataItem>\n"
+            << "        </Attribute>\n";
+
+      out << "      </Grid>\n";
+    }
+
+  out << "    </Grid>\n"
+      << "  </Domain>\n"
+      << "</Xdmf>\n";
+}
+
+#endif
+
+#endif
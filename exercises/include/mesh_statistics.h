@@ -0,0 +1,324 @@
+#ifndef mesh_statistics_h
+#define mesh_statistics_h
+
+#include <deal.II/base/timer.h>
+
+#include <deal.II/grid/tria.h>
+#include <deal.II/grid/tria_accessor.h>
+#include <deal.II/grid/tria_iterator.h>
+
+#include <boost/signals2/connection.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <vector>
+
+using namespace dealii;
+
+
+/**
+ * Statistics of a Triangulation: cells per level, memory, manifold ids, the
+ * distribution of cell diameters and aspect ratios, and the time spent in
+ * the last call to Triangulation::execute_coarsening_and_refinement() (which
+ * is also what refine_global() calls).
+ *
+ * The timing is obtained by connecting to the pre_refinement and
+ * post_refinement signals of the triangulation, so the object has to exist
+ * while the mesh is being refined. All other quantities are computed from
+ * the current state of the triangulation every time they are printed.
+ *
+ * print_summary() prints a human readable summary, write_json() all the
+ * statistics, and write_csv_header() and write_csv_row() one line per call,
+ * to track the growth of a mesh across refinements or runs.
+ */
+template <int dim, int spacedim = dim>
+class MeshStatistics
+{
+public:
+  MeshStatistics(const Triangulation<dim, spacedim> &triangulation,
+                 const unsigned int                  n_histogram_bins = 10);
+
+  ~MeshStatistics();
+
+  /**
+   * Print the number of levels, cells and active cells.
+   */
+  void
+  print_summary(std::ostream &out) const;
+
+  void
+  write_json(std::ostream &out) const;
+
+  static void
+  write_csv_header(std::ostream &out);
+
+  void
+  write_csv_row(std::ostream &out) const;
+
+private:
+  /**
+   * Minimum, maximum, mean and histogram of a quantity over the active cells.
+   */
+  struct Distribution
+  {
+    Distribution(const std::vector<double> &values, const unsigned int n_bins);
+
+    void
+    write_json(std::ostream &out) const;
+
+    double                    min;
+    double                    max;
+    double                    mean;
+    std::vector<unsigned int> histogram;
+  };
+
+  /**
+   * The ratio between the largest and the smallest extent of a cell along
+   * the directions of the reference cell.
+   */
+  static double
+  aspect_ratio(
+    const typename Triangulation<dim, spacedim>::active_cell_iterator &cell);
+
+  std::vector<double>
+  diameters() const;
+
+  std::vector<double>
+  aspect_ratios() const;
+
+  std::map<types::manifold_id, unsigned int>
+  manifold_id_histogram() const;
+
+  const Triangulation<dim, spacedim> &triangulation;
+  const unsigned int                  n_histogram_bins;
+
+  Timer  refinement_timer;
+  double last_refinement_time;
+
+  std::vector<boost::signals2::connection> connections;
+};
+
+
+
+template <int dim, int spacedim>
+MeshStatistics<dim, spacedim>::MeshStatistics(
+  const Triangulation<dim, spacedim> &triangulation,
+  const unsigned int                  n_histogram_bins)
+  : triangulation(triangulation)
+  , n_histogram_bins(n_histogram_bins)
+  , last_refinement_time(0)
+{
+  refinement_timer.stop();
+  connections.push_back(triangulation.signals.pre_refinement.connect(
+    [this]() { refinement_timer.restart(); }));
+  connections.push_back(
+    triangulation.signals.post_refinement.connect([this]() {
+      refinement_timer.stop();
+      last_refinement_time = refinement_timer.wall_time();
+    }));
+}
+
+
+
+template <int dim, int spacedim>
+MeshStatistics<dim, spacedim>::~MeshStatistics()
+{
+  for (auto &connection : connections)
+    connection.disconnect();
+}
+
+
+
+template <int dim, int spacedim>
+MeshStatistics<dim, spacedim>::Distribution::Distribution(
+  const std::vector<double> &values,
+  const unsigned int         n_bins)
+  : min(std::numeric_limits<double>::max())
+  , max(std::numeric_limits<double>::lowest())
+  , mean(0)
+  , histogram(n_bins, 0)
+{
+  if (values.empty())
+    {
+      min = max = 0;
+      return;
+    }
+
+  for (const double value : values)
+    {
+      min = std::min(min, value);
+      max = std::max(max, value);
+      mean += value;
+    }
+  mean /= values.size();
+
+  const double width = (max - min) / n_bins;
+  for (const double value : values)
+    {
+      const unsigned int bin =
+        (width > 0 ? static_cast<unsigned int>((value - min) / width) : 0);
+      ++histogram[std::min(bin, n_bins - 1)];
+    }
+}
+
+
+
+template <int dim, int spacedim>
+void
+MeshStatistics<dim, spacedim>::Distribution::write_json(std::ostream &out) const
+{
+  out << "{\"min\": " << min << ", \"max\": " << max << ", \"mean\": " << mean
+      << ", \"histogram\": [";
+  for (unsigned int i = 0; i < histogram.size(); ++i)
+    out << (i > 0 ? ", " : "") << histogram[i];
+  out << "]}";
+}
+
+
+
+template <int dim, int spacedim>
+double
+MeshStatistics<dim, spacedim>::aspect_ratio(
+  const typename Triangulation<dim, spacedim>::active_cell_iterator &cell)
+{
+  double min_extent = std::numeric_limits<double>::max();
+  double max_extent = 0;
+  for (unsigned int d = 0; d < dim; ++d)
+    {
+      const double extent = cell->extent_in_direction(d);
+      min_extent          = std::min(min_extent, extent);
+      max_extent          = std::max(max_extent, extent);
+    }
+  return max_extent / min_extent;
+}
+
+
+
+template <int dim, int spacedim>
+std::vector<double>
+MeshStatistics<dim, spacedim>::diameters() const
+{
+  std::vector<double> values;
+  values.reserve(triangulation.n_active_cells());
+  for (const auto &cell : triangulation.active_cell_iterators())
+    values.push_back(cell->diameter());
+  return values;
+}
+
+
+
+template <int dim, int spacedim>
+std::vector<double>
+MeshStatistics<dim, spacedim>::aspect_ratios() const
+{
+  std::vector<double> values;
+  values.reserve(triangulation.n_active_cells());
+  for (const auto &cell : triangulation.active_cell_iterators())
+    values.push_back(aspect_ratio(cell));
+  return values;
+}
+
+
+
+template <int dim, int spacedim>
+std::map<types::manifold_id, unsigned int>
+MeshStatistics<dim, spacedim>::manifold_id_histogram() const
+{
+  std::map<types::manifold_id, unsigned int> histogram;
+  for (const auto &cell : triangulation.active_cell_iterators())
+    ++histogram[cell->manifold_id()];
+  return histogram;
+}
+
+
+
+template <int dim, int spacedim>
+void
+MeshStatistics<dim, spacedim>::print_summary(std::ostream &out) const
+{
+  out << "Number of levels: " << triangulation.n_levels() << std::endl
+      << "Number of cells: " << triangulation.n_cells() << std::endl
+      << "Number of active cells: " << triangulation.n_active_cells()
+      << std::endl;
+}
+
+
+
+template <int dim, int spacedim>
+void
+MeshStatistics<dim, spacedim>::write_json(std::ostream &out) const
+{
+  // Triangulation only reports its total memory consumption. The per-level
+  // figures distribute it proportionally to the number of cells.
+  const std::size_t memory = triangulation.memory_consumption();
+
+  out << "{" << std::endl
+      << "  \"dim\": " << dim << "," << std::endl
+      << "  \"spacedim\": " << spacedim << "," << std::endl
+      << "  \"n_levels\": " << triangulation.n_levels() << "," << std::endl
+      << "  \"n_cells\": " << triangulation.n_cells() << "," << std::endl
+      << "  \"n_active_cells\": " << triangulation.n_active_cells() << ","
+      << std::endl
+      << "  \"memory_consumption\": " << memory << "," << std::endl
+      << "  \"last_refinement_time\": " << last_refinement_time << ","
+      << std::endl;
+
+  out << "  \"levels\": [" << std::endl;
+  for (unsigned int level = 0; level < triangulation.n_levels(); ++level)
+    out << "    {\"level\": " << level
+        << ", \"n_cells\": " << triangulation.n_cells(level)
+        << ", \"n_active_cells\": " << triangulation.n_active_cells(level)
+        << ", \"estimated_memory_consumption\": "
+        << static_cast<std::size_t>(1. * memory * triangulation.n_cells(level) /
+                                    triangulation.n_cells())
+        << "}" << (level + 1 < triangulation.n_levels() ? "," : "")
+        << std::endl;
+  out << "  ]," << std::endl;
+
+  out << "  \"manifold_ids\": {";
+  const auto manifold_ids = manifold_id_histogram();
+  for (auto it = manifold_ids.begin(); it != manifold_ids.end(); ++it)
+    out << (it != manifold_ids.begin() ? ", " : "") << "\""
+        << (it->first == numbers::flat_manifold_id ?
+              std::string("flat") :
+              std::to_string(it->first))
+        << "\": " << it->second;
+  out << "}," << std::endl;
+
+  out << "  \"diameter\": ";
+  Distribution(diameters(), n_histogram_bins).write_json(out);
+  out << "," << std::endl << "  \"aspect_ratio\": ";
+  Distribution(aspect_ratios(), n_histogram_bins).write_json(out);
+  out << std::endl << "}" << std::endl;
+}
+
+
+
+template <int dim, int spacedim>
+void
+MeshStatistics<dim, spacedim>::write_csv_header(std::ostream &out)
+{
+  out << "dim,n_levels,n_cells,n_active_cells,memory_consumption,"
+      << "min_diameter,max_diameter,min_aspect_ratio,max_aspect_ratio,"
+      << "last_refinement_time" << std::endl;
+}
+
+
+
+template <int dim, int spacedim>
+void
+MeshStatistics<dim, spacedim>::write_csv_row(std::ostream &out) const
+{
+  const Distribution diameter(diameters(), n_histogram_bins);
+  const Distribution aspect(aspect_ratios(), n_histogram_bins);
+
+  out << dim << ',' << triangulation.n_levels() << ','
+      << triangulation.n_cells() << ',' << triangulation.n_active_cells() << ','
+      << triangulation.memory_consumption() << ',' << diameter.min << ','
+      << diameter.max << ',' << aspect.min << ',' << aspect.max << ','
+      << last_refinement_time << std::endl;
+}
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef mixed_precision_cg_h
+#define mixed_precision_cg_h
+
+#include <deal.II/lac/precondition.h>
+#include <deal.II/lac/solver_cg.h>
+#include <deal.II/lac/solver_control.h>
+#include <deal.II/lac/sparse_matrix.h>
+#include <deal.II/lac/vector.h>
+
+#include <cstddef>
+
+using namespace dealii;
+
+
+/**
+ * CG for a SparseMatrix<double>, with the iterations in single precision.
+ *
+ * The solver keeps a SparseMatrix<float> copy of the matrix and refines the
+ * solution in double precision: in every outer step, the residual
+ * $r = b - Ax$ is computed in double, the correction $Ad = r$ is solved
+ * approximately with SSOR-preconditioned CG on the float copy, and
+ * $x \leftarrow x + d$. The SolverControl passed to the constructor decides
+ * when the double residual is small enough, so the final accuracy is that
+ * of a double solve, while the CG iterations read half as many bytes of
+ * matrix and vector entries.
+ *
+ * The saving is in bandwidth, not in memory: the caller keeps the double
+ * matrix to compute the residuals, and the float copy comes on top of it,
+ * sharing only the SparsityPattern.
+ *
+ * The inner solve only has to reduce the residual by a factor that single
+ * precision can represent, by default 1e-4. Each residual is scaled to unit
+ * norm before it is rounded to float.
+ */
+class MixedPrecisionCG
+{
+public:
+  struct AdditionalData
+  {
+    AdditionalData(const double       inner_reduction      = 1e-4,
+                   const unsigned int max_inner_iterations = 1000,
+                   const double       relaxation           = 1.2);
+
+    double       inner_reduction;
+    unsigned int max_inner_iterations;
+    double       relaxation;
+  };
+
+  MixedPrecisionCG(SolverControl &       solver_control,
+                   const AdditionalData &additional_data = AdditionalData());
+
+  /**
+   * Solve A x = b, with @p solution as the starting guess. Throws
+   * SolverControl::NoConvergence if the outer iteration fails.
+   */
+  void
+  solve(const SparseMatrix<double> &matrix,
+        Vector<double> &            solution,
+        const Vector<double> &      rhs);
+
+  unsigned int
+  n_outer_iterations() const;
+
+  /**
+   * The number of single precision CG iterations of the last solve, summed
+   * over all outer steps.
+   */
+  unsigned int
+  n_inner_iterations() const;
+
+  /**
+   * The memory the solver holds: the values of the float copy of the matrix,
+   * the float vectors of the inner solve and the double residual and
+   * correction of the outer one. Neither the double matrix, nor the
+   * SparsityPattern both matrices share, nor the vectors of the caller are
+   * included.
+   */
+  std::size_t
+  memory_consumption() const;
+
+private:
+  SolverControl &      solver_control;
+  const AdditionalData additional_data;
+
+  SparseMatrix<float> float_matrix;
+  Vector<float>       float_residual;
+  Vector<float>       float_correction;
+  Vector<double>      residual;
+  Vector<double>      correction;
+
+  unsigned int outer_iterations;
+  unsigned int inner_iterations;
+};
+
+
+
+inline MixedPrecisionCG::AdditionalData::AdditionalData(
+  const double       inner_reduction,
+  const unsigned int max_inner_iterations,
+  const double       relaxation)
+  : inner_reduction(inner_reduction)
+  , max_inner_iterations(max_inner_iterations)
+  , relaxation(relaxation)
+{}
+
+
+
+inline MixedPrecisionCG::MixedPrecisionCG(
+  SolverControl &       solver_control,
+  const AdditionalData &additional_data)
+  : solver_control(solver_control)
+  , additional_data(additional_data)
+  , outer_iterations(0)
+  , inner_iterations(0)
+{}
+
+
+
+inline void
+MixedPrecisionCG::solve(const SparseMatrix<double> &matrix,
+                        Vector<double> &            solution,
+                        const Vector<double> &      rhs)
+{
+  float_matrix.reinit(matrix.get_sparsity_pattern());
+  float_matrix.copy_from(matrix);
+
+  PreconditionSSOR<SparseMatrix<float>> preconditioner;
+  preconditioner.initialize(float_matrix, additional_data.relaxation);
+
+  float_residual.reinit(rhs.size());
+  float_correction.reinit(rhs.size());
+  residual.reinit(rhs.size());
+  correction.reinit(rhs.size());
+
+  outer_iterations = 0;
+  inner_iterations = 0;
+
+  double residual_norm = matrix.residual(residual, solution, rhs);
+  SolverControl::State state =
+    solver_control.check(outer_iterations, residual_norm);
+
+  while (state == SolverControl::iterate)
+    {
+      residual /= residual_norm;
+
+      float_residual   = residual;
+      float_correction = 0;
+
+      ReductionControl inner_control(additional_data.max_inner_iterations,
+                                     0.,
+                                     additional_data.inner_reduction,
+                                     false,
+                                     false);
+      SolverCG<Vector<float>> inner_solver(inner_control);
+      try
+        {
+          inner_solver.solve(float_matrix,
+                             float_correction,
+                             float_residual,
+                             preconditioner);
+        }
+      catch (SolverControl::NoConvergence &)
+        {
+          // A partly converged correction still reduces the error, and the
+          // outer iteration catches the rest.
+        }
+      inner_iterations += inner_control.last_step();
+
+      correction = float_correction;
+      solution.add(residual_norm, correction);
+
+      residual_norm = matrix.residual(residual, solution, rhs);
+      state         = solver_control.check(++outer_iterations, residual_norm);
+    }
+
+  AssertThrow(state == SolverControl::success,
+              SolverControl::NoConvergence(solver_control.last_step(),
+                                           solver_control.last_value()));
+}
+
+
+
+inline unsigned int
+MixedPrecisionCG::n_outer_iterations() const
+{
+  return outer_iterations;
+}
+
+
+
+inline unsigned int
+MixedPrecisionCG::n_inner_iterations() const
+{
+  return inner_iterations;
+}
+
+
+
+inline std::size_t
+MixedPrecisionCG::memory_consumption() const
+{
+  return float_matrix.memory_consumption() +
+         float_residual.memory_consumption() +
+         float_correction.memory_consumption() +
+         residual.memory_consumption() + correction.memory_consumption();
+}
+
+#endif
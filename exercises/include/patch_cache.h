@@ -0,0 +1,364 @@
+#ifndef patch_cache_h
+#define patch_cache_h
+
+#include <deal.II/base/data_out_base.h>
+#include <deal.II/base/parallel.h>
+#include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/smartpointer.h>
+
+#include <deal.II/dofs/dof_accessor.h>
+#include <deal.II/dofs/dof_handler.h>
+
+#include <deal.II/fe/fe_values.h>
+#include <deal.II/fe/mapping.h>
+
+#include <deal.II/lac/vector.h>
+
+#include <boost/signals2/connection.hpp>
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace dealii;
+
+
+/**
+ * The patches DataOut::build_patches() creates with
+ * DataOut::curved_inner_cells, split into the part that only depends on the
+ * mesh and the part that depends on the data.
+ *
+ * The mapped points of the patches, the most expensive part of building
+ * them for higher order mappings, and the DoF indices of the cells are
+ * computed once, in parallel over the cells, and kept until the
+ * triangulation changes. Writing a set of data vectors then only evaluates
+ * them at the patch points, which, since the shape functions of a scalar or
+ * primitive element at given reference points do not depend on the mapping,
+ * is a small matrix-vector product per cell with values tabulated once.
+ *
+ * If the DoFs are renumbered without a change of the mesh, invalidate() has
+ * to be called.
+ */
+template <int dim, int spacedim = dim>
+class PatchCache
+{
+public:
+  PatchCache(const DoFHandler<dim, spacedim> &dof_handler,
+             const Mapping<dim, spacedim> &   mapping,
+             const unsigned int               n_subdivisions);
+
+  ~PatchCache();
+
+  void
+  invalidate();
+
+  /**
+   * Add a vector with one entry per DoF or one per active cell. Like with
+   * DataOut, the vector has to live until the output is written.
+   */
+  template <typename number>
+  void
+  add_data_vector(const Vector<number> &vector, const std::string &name);
+
+  void
+  clear_data_vectors();
+
+  /**
+   * Write the patches of all active cells, or of those with the active cell
+   * indices @p cells only, with the current data vectors.
+   */
+  void
+  write_vtu(std::ostream &                   out,
+            const DataOutBase::VtkFlags &    flags = DataOutBase::VtkFlags(),
+            const std::vector<unsigned int> &cells =
+              std::vector<unsigned int>());
+
+private:
+  struct DataVector
+  {
+    std::string                                    name;
+    bool                                           is_cell_data;
+    std::function<double(types::global_dof_index)> value;
+  };
+
+  void
+  build();
+
+  /**
+   * Fill the data rows of @p patch from the data vectors, keeping its
+   * points in the last spacedim rows.
+   */
+  void
+  fill_data(DataOutBase::Patch<dim, spacedim> &patch,
+            const unsigned int                 cell) const;
+
+  SmartPointer<const DoFHandler<dim, spacedim>> dof_handler;
+  SmartPointer<const Mapping<dim, spacedim>>    mapping;
+  const unsigned int                            n_subdivisions;
+  const Quadrature<dim>                         patch_points;
+
+  /**
+   * Values of the shape functions at the patch points, and the vector
+   * component of each shape function.
+   */
+  FullMatrix<double>        shape_values;
+  std::vector<unsigned int> shape_components;
+
+  bool                                 valid;
+  std::vector<types::global_dof_index> cell_dofs;
+
+  std::vector<DataOutBase::Patch<dim, spacedim>> patches;
+
+  std::vector<DataVector> data_vectors;
+
+  boost::signals2::connection mesh_changed;
+};
+
+
+
+template <int dim, int spacedim>
+PatchCache<dim, spacedim>::PatchCache(
+  const DoFHandler<dim, spacedim> &dof_handler,
+  const Mapping<dim, spacedim> &   mapping,
+  const unsigned int               n_subdivisions)
+  : dof_handler(&dof_handler)
+  , mapping(&mapping)
+  , n_subdivisions(n_subdivisions)
+  , patch_points(QIterated<dim>(QTrapez<1>(), n_subdivisions))
+  , valid(false)
+{
+  mesh_changed = dof_handler.get_triangulation().signals.any_change.connect(
+    [this]() { invalidate(); });
+}
+
+
+
+template <int dim, int spacedim>
+PatchCache<dim, spacedim>::~PatchCache()
+{
+  mesh_changed.disconnect();
+}
+
+
+
+template <int dim, int spacedim>
+void
+PatchCache<dim, spacedim>::invalidate()
+{
+  valid = false;
+  patches.clear();
+  cell_dofs.clear();
+}
+
+
+
+template <int dim, int spacedim>
+template <typename number>
+void
+PatchCache<dim, spacedim>::add_data_vector(const Vector<number> &vector,
+                                           const std::string &   name)
+{
+  const bool is_cell_data = (vector.size() != dof_handler->n_dofs());
+  Assert(!is_cell_data ||
+           vector.size() ==
+             dof_handler->get_triangulation().n_active_cells(),
+         ExcMessage("The vector has neither one entry per DoF nor one per "
+                    "active cell."));
+
+  data_vectors.push_back(
+    {name, is_cell_data, [&vector](const types::global_dof_index i) {
+       return static_cast<double>(vector(i));
+     }});
+}
+
+
+
+template <int dim, int spacedim>
+void
+PatchCache<dim, spacedim>::clear_data_vectors()
+{
+  data_vectors.clear();
+}
+
+
+
+template <int dim, int spacedim>
+void
+PatchCache<dim, spacedim>::build()
+{
+  const FiniteElement<dim, spacedim> &fe            = dof_handler->get_fe();
+  const unsigned int                  dofs_per_cell = fe.dofs_per_cell;
+  const unsigned int                  n_points      = patch_points.size();
+  Assert(fe.is_primitive(),
+         ExcMessage("The shape functions of the element must be primitive."));
+
+  shape_values.reinit(n_points, dofs_per_cell);
+  shape_components.resize(dofs_per_cell);
+  for (unsigned int i = 0; i < dofs_per_cell; ++i)
+    {
+      shape_components[i] = fe.system_to_component_index(i).first;
+      for (unsigned int q = 0; q < n_points; ++q)
+        shape_values(q, i) = fe.shape_value(i, patch_points.point(q));
+    }
+
+  std::vector<typename DoFHandler<dim, spacedim>::active_cell_iterator> cells;
+  for (const auto &cell : dof_handler->active_cell_iterators())
+    cells.push_back(cell);
+
+  patches.resize(cells.size());
+  cell_dofs.resize(cells.size() * dofs_per_cell);
+
+  parallel::apply_to_subranges(
+    0u,
+    static_cast<unsigned int>(cells.size()),
+    [&](const unsigned int begin, const unsigned int end) {
+      FEValues<dim, spacedim> fe_values(*mapping,
+                                        fe,
+                                        patch_points,
+                                        update_quadrature_points);
+      std::vector<types::global_dof_index> local_dof_indices(dofs_per_cell);
+      for (unsigned int c = begin; c < end; ++c)
+        {
+          const auto &cell = cells[c];
+          fe_values.reinit(cell);
+
+          DataOutBase::Patch<dim, spacedim> &patch = patches[c];
+          for (unsigned int v = 0; v < GeometryInfo<dim>::vertices_per_cell;
+               ++v)
+            patch.vertices[v] = cell->vertex(v);
+          patch.n_subdivisions       = n_subdivisions;
+          patch.patch_index          = c;
+          patch.points_are_available = true;
+          patch.data.reinit(spacedim, n_points);
+          for (unsigned int q = 0; q < n_points; ++q)
+            for (unsigned int d = 0; d < spacedim; ++d)
+              patch.data(d, q) = fe_values.quadrature_point(q)[d];
+
+          cell->get_dof_indices(local_dof_indices);
+          std::copy(local_dof_indices.begin(),
+                    local_dof_indices.end(),
+                    cell_dofs.begin() + c * dofs_per_cell);
+        }
+    },
+    32);
+
+  valid = true;
+}
+
+
+
+template <int dim, int spacedim>
+void
+PatchCache<dim, spacedim>::fill_data(DataOutBase::Patch<dim, spacedim> &patch,
+                                     const unsigned int cell) const
+{
+  const unsigned int n_components  = dof_handler->get_fe().n_components();
+  const unsigned int dofs_per_cell = dof_handler->get_fe().dofs_per_cell;
+  const unsigned int n_points      = patch_points.size();
+
+  unsigned int n_data = 0;
+  for (const auto &data_vector : data_vectors)
+    n_data += (data_vector.is_cell_data ? 1 : n_components);
+
+  // Move the points to the new last rows if the number of rows changed.
+  if (patch.data.n_rows() != n_data + spacedim)
+    {
+      const unsigned int first_point_row = patch.data.n_rows() - spacedim;
+      Table<2, float>    data(n_data + spacedim, n_points);
+      for (unsigned int d = 0; d < spacedim; ++d)
+        for (unsigned int q = 0; q < n_points; ++q)
+          data(n_data + d, q) = patch.data(first_point_row + d, q);
+      patch.data.swap(data);
+    }
+
+  const types::global_dof_index *dofs = &cell_dofs[cell * dofs_per_cell];
+  std::vector<double>            local_values(dofs_per_cell);
+
+  unsigned int row = 0;
+  for (const auto &data_vector : data_vectors)
+    if (data_vector.is_cell_data)
+      {
+        const double value = data_vector.value(cell);
+        for (unsigned int q = 0; q < n_points; ++q)
+          patch.data(row, q) = value;
+        ++row;
+      }
+    else
+      {
+        for (unsigned int i = 0; i < dofs_per_cell; ++i)
+          local_values[i] = data_vector.value(dofs[i]);
+        for (unsigned int c = 0; c < n_components; ++c)
+          for (unsigned int q = 0; q < n_points; ++q)
+            {
+              double value = 0;
+              for (unsigned int i = 0; i < dofs_per_cell; ++i)
+                if (shape_components[i] == c)
+                  value += shape_values(q, i) * local_values[i];
+              patch.data(row + c, q) = value;
+            }
+        row += n_components;
+      }
+}
+
+
+
+template <int dim, int spacedim>
+void
+PatchCache<dim, spacedim>::write_vtu(std::ostream &                   out,
+                                     const DataOutBase::VtkFlags &    flags,
+                                     const std::vector<unsigned int> &cells)
+{
+  if (!valid)
+    build();
+
+  const unsigned int n_components = dof_handler->get_fe().n_components();
+
+  std::vector<std::string> data_names;
+  for (const auto &data_vector : data_vectors)
+    if (data_vector.is_cell_data || n_components == 1)
+      data_names.push_back(data_vector.name);
+    else
+      for (unsigned int c = 0; c < n_components; ++c)
+        data_names.push_back(data_vector.name + "_" + std::to_string(c));
+
+  const std::vector<
+    std::tuple<unsigned int,
+               unsigned int,
+               std::string,
+               DataComponentInterpretation::DataComponentInterpretation>>
+    nonscalar_data_ranges;
+
+  if (cells.empty())
+    {
+      parallel::apply_to_subranges(
+        0u,
+        static_cast<unsigned int>(patches.size()),
+        [&](const unsigned int begin, const unsigned int end) {
+          for (unsigned int c = begin; c < end; ++c)
+            fill_data(patches[c], c);
+        },
+        32);
+
+      DataOutBase::write_vtu(
+        patches, data_names, nonscalar_data_ranges, flags, out);
+    }
+  else
+    {
+      std::vector<DataOutBase::Patch<dim, spacedim>> selected_patches;
+      selected_patches.reserve(cells.size());
+      for (const unsigned int c : cells)
+        {
+          AssertIndexRange(c, patches.size());
+          fill_data(patches[c], c);
+          selected_patches.push_back(patches[c]);
+          selected_patches.back().patch_index = selected_patches.size() - 1;
+        }
+
+      DataOutBase::write_vtu(
+        selected_patches, data_names, nonscalar_data_ranges, flags, out);
+    }
+}
+
+#endif
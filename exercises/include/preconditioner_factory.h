@@ -0,0 +1,416 @@
+#ifndef preconditioner_factory_h
+#define preconditioner_factory_h
+
+#include <deal.II/base/parameter_handler.h>
+#include <deal.II/base/timer.h>
+#include <deal.II/base/utilities.h>
+
+#include <deal.II/lac/diagonal_matrix.h>
+#include <deal.II/lac/precondition.h>
+#include <deal.II/lac/solver_cg.h>
+#include <deal.II/lac/sparse_ilu.h>
+#include <deal.II/lac/sparse_matrix.h>
+#include <deal.II/lac/vector.h>
+
+#ifdef DEAL_II_WITH_TRILINOS
+#  include <deal.II/lac/trilinos_precondition.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace dealii;
+
+
+/**
+ * CG with a preconditioner chosen at run time, for a SparseMatrix<double>.
+ *
+ * The available preconditioners are identity, jacobi, ssor, chebyshev (on
+ * the Jacobi-preconditioned matrix, with the extremal eigenvalues estimated
+ * by a few Lanczos steps of CG), ilu (ILU(0), i.e. SparseILU without extra
+ * fill-in) and, if deal.II was configured with Trilinos, amg (ML). SSOR
+ * takes a list of relaxation parameters: the system is then solved once
+ * per value, and the fastest solution is kept, which makes it easy to find
+ * the best value for a given mesh. A value for which CG does not converge
+ * is reported and skipped.
+ *
+ * Each solve prints the setup time of the preconditioner, the number of CG
+ * iterations and the time per iteration, and returns the setup and solve
+ * times of the kept solution separately.
+ *
+ * The default type is given to the constructor, so that every program
+ * keeps its own preconditioner unless another one is selected.
+ *
+ * The parameters live in the subsection "Preconditioner" of a
+ * ParameterHandler. parse_command_line() reads them from the file given by
+ * --parameters=<file>, and --preconditioner=<type> overrides the type.
+ */
+class PreconditionerFactory
+{
+public:
+  /**
+   * What solve() reports: the number of CG iterations, the time to set up
+   * the preconditioner and the time of the CG iterations.
+   */
+  struct SolveStatistics
+  {
+    unsigned int n_iterations;
+    double       setup_time;
+    double       solve_time;
+  };
+
+  PreconditionerFactory(const std::string &default_type = "ssor");
+
+  static void
+  declare_parameters(ParameterHandler & prm,
+                     const std::string &default_type = "ssor");
+
+  void
+  parse_parameters(ParameterHandler &prm);
+
+  void
+  parse_command_line(const int argc, char **argv);
+
+  /**
+   * The selected preconditioner, one of the names listed above.
+   */
+  const std::string &
+  get_type() const;
+
+  /**
+   * The relaxation parameters of SSOR.
+   */
+  const std::vector<double> &
+  get_ssor_relaxations() const;
+
+  /**
+   * Solve A x = b with CG. @p solution is the starting guess.
+   */
+  SolveStatistics
+  solve(const SparseMatrix<double> &matrix,
+        Vector<double> &            solution,
+        const Vector<double> &      rhs,
+        SolverControl &             solver_control) const;
+
+private:
+  template <typename PreconditionerType>
+  SolveStatistics
+  run_cg(const SparseMatrix<double> &matrix,
+         Vector<double> &            solution,
+         const Vector<double> &      rhs,
+         SolverControl &             solver_control,
+         const PreconditionerType &  preconditioner,
+         const double                setup_time,
+         const std::string &         name) const;
+
+  std::string         default_type;
+  std::string         type;
+  double              jacobi_relaxation;
+  std::vector<double> ssor_relaxations;
+  unsigned int        chebyshev_degree;
+  double              chebyshev_smoothing_range;
+  unsigned int        chebyshev_eigenvalue_iterations;
+  bool                amg_elliptic;
+  unsigned int        amg_smoother_sweeps;
+};
+
+
+
+inline PreconditionerFactory::PreconditionerFactory(
+  const std::string &default_type)
+  : default_type(default_type)
+{
+  ParameterHandler prm;
+  declare_parameters(prm, default_type);
+  parse_parameters(prm);
+}
+
+
+
+inline void
+PreconditionerFactory::declare_parameters(ParameterHandler & prm,
+                                          const std::string &default_type)
+{
+  prm.enter_subsection("Preconditioner");
+  {
+    prm.declare_entry("Type",
+                      default_type,
+                      Patterns::Selection(
+                        "identity|jacobi|ssor|chebyshev|ilu|amg"),
+                      "The preconditioner of CG.");
+    prm.declare_entry("Jacobi relaxation",
+                      "1.0",
+                      Patterns::Double(0.),
+                      "Relaxation parameter of Jacobi.");
+    prm.declare_entry("SSOR relaxation",
+                      "1.2",
+                      Patterns::List(Patterns::Double(0., 2.)),
+                      "Relaxation parameters of SSOR. With more than one, "
+                      "the system is solved for each and the fastest "
+                      "solution is kept.");
+    prm.declare_entry("Chebyshev degree",
+                      "4",
+                      Patterns::Integer(1),
+                      "Degree of the Chebyshev polynomial.");
+    prm.declare_entry("Chebyshev smoothing range",
+                      "30",
+                      Patterns::Double(1.),
+                      "Ratio of the largest eigenvalue to the smallest one "
+                      "the polynomial is built for.");
+    prm.declare_entry("Chebyshev eigenvalue iterations",
+                      "12",
+                      Patterns::Integer(1),
+                      "Number of CG (Lanczos) iterations estimating the "
+                      "largest eigenvalue.");
+    prm.declare_entry("AMG elliptic",
+                      "true",
+                      Patterns::Bool(),
+                      "Use the settings of ML for elliptic problems.");
+    prm.declare_entry("AMG smoother sweeps",
+                      "2",
+                      Patterns::Integer(1),
+                      "Number of smoother sweeps on each level.");
+  }
+  prm.leave_subsection();
+}
+
+
+
+inline void
+PreconditionerFactory::parse_parameters(ParameterHandler &prm)
+{
+  prm.enter_subsection("Preconditioner");
+  {
+    type              = prm.get("Type");
+    jacobi_relaxation = prm.get_double("Jacobi relaxation");
+    ssor_relaxations  = Utilities::string_to_double(
+      Utilities::split_string_list(prm.get("SSOR relaxation")));
+    chebyshev_degree          = prm.get_integer("Chebyshev degree");
+    chebyshev_smoothing_range = prm.get_double("Chebyshev smoothing range");
+    chebyshev_eigenvalue_iterations =
+      prm.get_integer("Chebyshev eigenvalue iterations");
+    amg_elliptic        = prm.get_bool("AMG elliptic");
+    amg_smoother_sweeps = prm.get_integer("AMG smoother sweeps");
+  }
+  prm.leave_subsection();
+
+  AssertThrow(!ssor_relaxations.empty(),
+              ExcMessage("SSOR needs at least one relaxation parameter."));
+}
+
+
+
+inline void
+PreconditionerFactory::parse_command_line(const int argc, char **argv)
+{
+  ParameterHandler prm;
+  declare_parameters(prm, default_type);
+
+  std::string type_override;
+  for (int i = 1; i < argc; ++i)
+    {
+      const std::string argument = argv[i];
+      if (argument.compare(0, 13, "--parameters=") == 0)
+        prm.parse_input(argument.substr(13));
+      else if (argument.compare(0, 17, "--preconditioner=") == 0)
+        type_override = argument.substr(17);
+    }
+
+  if (!type_override.empty())
+    {
+      prm.enter_subsection("Preconditioner");
+      prm.set("Type", type_override);
+      prm.leave_subsection();
+    }
+
+  parse_parameters(prm);
+}
+
+
+
+inline const std::string &
+PreconditionerFactory::get_type() const
+{
+  return type;
+}
+
+
+
+inline const std::vector<double> &
+PreconditionerFactory::get_ssor_relaxations() const
+{
+  return ssor_relaxations;
+}
+
+
+
+template <typename PreconditionerType>
+PreconditionerFactory::SolveStatistics
+PreconditionerFactory::run_cg(const SparseMatrix<double> &matrix,
+                              Vector<double> &            solution,
+                              const Vector<double> &      rhs,
+                              SolverControl &             solver_control,
+                              const PreconditionerType &  preconditioner,
+                              const double                setup_time,
+                              const std::string &         name) const
+{
+  SolverCG<> solver(solver_control);
+
+  Timer timer;
+  solver.solve(matrix, solution, rhs, preconditioner);
+  const double solve_time = timer.wall_time();
+
+  const unsigned int n_iterations = solver_control.last_step();
+  std::cout << "   " << name << ": setup " << setup_time << "s, "
+            << n_iterations << " CG iterations, "
+            << solve_time / std::max(n_iterations, 1u) << "s per iteration"
+            << std::endl;
+
+  return {n_iterations, setup_time, solve_time};
+}
+
+
+
+inline PreconditionerFactory::SolveStatistics
+PreconditionerFactory::solve(const SparseMatrix<double> &matrix,
+                             Vector<double> &            solution,
+                             const Vector<double> &      rhs,
+                             SolverControl &             solver_control) const
+{
+  Timer timer;
+
+  if (type == "identity")
+    return run_cg(matrix,
+                  solution,
+                  rhs,
+                  solver_control,
+                  PreconditionIdentity(),
+                  0.,
+                  type);
+  else if (type == "jacobi")
+    {
+      PreconditionJacobi<> preconditioner;
+      preconditioner.initialize(matrix, jacobi_relaxation);
+      return run_cg(matrix,
+                    solution,
+                    rhs,
+                    solver_control,
+                    preconditioner,
+                    timer.wall_time(),
+                    type);
+    }
+  else if (type == "ssor")
+    {
+      const Vector<double> initial_guess = solution;
+      Vector<double>       candidate;
+      SolveStatistics      best      = {0, 0., 0.};
+      bool                 converged = false;
+      for (const double omega : ssor_relaxations)
+        {
+          const std::string name = "ssor(" + std::to_string(omega) + ")";
+          candidate              = initial_guess;
+          timer.restart();
+          PreconditionSSOR<> preconditioner;
+          preconditioner.initialize(matrix, omega);
+          try
+            {
+              const SolveStatistics statistics = run_cg(matrix,
+                                                        candidate,
+                                                        rhs,
+                                                        solver_control,
+                                                        preconditioner,
+                                                        timer.wall_time(),
+                                                        name);
+              const double time =
+                statistics.setup_time + statistics.solve_time;
+              if (!converged || time < best.setup_time + best.solve_time)
+                {
+                  best      = statistics;
+                  converged = true;
+                  solution  = candidate;
+                }
+            }
+          catch (SolverControl::NoConvergence &)
+            {
+              std::cout << "   " << name << ": no convergence in "
+                        << solver_control.last_step() << " CG iterations"
+                        << std::endl;
+            }
+        }
+      AssertThrow(converged,
+                  ExcMessage("CG did not converge with any of the SSOR "
+                             "relaxation parameters."));
+      return best;
+    }
+  else if (type == "chebyshev")
+    {
+      using Preconditioner =
+        PreconditionChebyshev<SparseMatrix<double>, Vector<double>>;
+      Preconditioner::AdditionalData data;
+      data.degree              = chebyshev_degree;
+      data.smoothing_range     = chebyshev_smoothing_range;
+      data.eig_cg_n_iterations = chebyshev_eigenvalue_iterations;
+      data.preconditioner.reset(new DiagonalMatrix<Vector<double>>());
+      data.preconditioner->get_vector().reinit(matrix.m());
+      for (unsigned int i = 0; i < matrix.m(); ++i)
+        data.preconditioner->get_vector()(i) = 1. / matrix.diag_element(i);
+
+      Preconditioner preconditioner;
+      preconditioner.initialize(matrix, data);
+      // The eigenvalues are estimated in the first application, which is
+      // part of the setup.
+      Vector<double> tmp(matrix.m());
+      preconditioner.vmult(tmp, rhs);
+      return run_cg(matrix,
+                    solution,
+                    rhs,
+                    solver_control,
+                    preconditioner,
+                    timer.wall_time(),
+                    type);
+    }
+  else if (type == "ilu")
+    {
+      SparseILU<double> preconditioner;
+      preconditioner.initialize(matrix, SparseILU<double>::AdditionalData());
+      return run_cg(matrix,
+                    solution,
+                    rhs,
+                    solver_control,
+                    preconditioner,
+                    timer.wall_time(),
+                    type);
+    }
+  else if (type == "amg")
+    {
+#ifdef DEAL_II_WITH_TRILINOS
+      TrilinosWrappers::PreconditionAMG::AdditionalData data;
+      data.elliptic              = amg_elliptic;
+      data.smoother_sweeps       = amg_smoother_sweeps;
+      data.aggregation_threshold = 0.02;
+
+      TrilinosWrappers::PreconditionAMG preconditioner;
+      preconditioner.initialize(matrix, data);
+      return run_cg(matrix,
+                    solution,
+                    rhs,
+                    solver_control,
+                    preconditioner,
+                    timer.wall_time(),
+                    type);
+#else
+      AssertThrow(false,
+                  ExcMessage("The AMG preconditioner needs deal.II to be "
+                             "configured with Trilinos."));
+#endif
+    }
+  else
+    AssertThrow(false, ExcMessage("Unknown preconditioner " + type));
+
+  return SolveStatistics();
+}
+
+#endif
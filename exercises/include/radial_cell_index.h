@@ -0,0 +1,330 @@
+#ifndef radial_cell_index_h
+#define radial_cell_index_h
+
+#include <deal.II/base/geometry_info.h>
+#include <deal.II/base/parallel.h>
+#include <deal.II/base/point.h>
+
+#include <deal.II/grid/tria.h>
+#include <deal.II/grid/tria_accessor.h>
+#include <deal.II/grid/tria_iterator.h>
+
+#include <boost/signals2/connection.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace dealii;
+
+
+/**
+ * An index of the active cells of a triangulation, bucketed by the distance
+ * of their vertices from a center point.
+ *
+ * Every active cell is stored in the buckets of the distances of its
+ * vertices. Looking up the cells touching the sphere of a given radius
+ * visits the one or two buckets around that radius, so its cost is
+ * proportional to the number of cells in these buckets rather than to the
+ * size of the mesh.
+ *
+ * Each bucket is a std::set of cell ids, so the index costs one set node,
+ * about 40 bytes, per vertex of every active cell, plus one hash map entry
+ * per non-empty bucket. Buckets as narrow as the tolerance would give a
+ * separate set for every distinct vertex radius, so by default the width is
+ * 1/1024 of the largest vertex distance from the center, determined
+ * whenever the index is rebuilt, and at least twice the tolerance. A
+ * different width can be passed to the constructor.
+ *
+ * The index follows refinement and coarsening of the triangulation through
+ * its signals: when a cell is refined, only that cell and its children are
+ * updated. This is what makes repeated marking near a surface cheap, as in
+ * second_grid() of step-1.
+ */
+template <int dim, int spacedim = dim>
+class RadialCellIndex
+{
+public:
+  using cell_iterator = typename Triangulation<dim, spacedim>::cell_iterator;
+  using active_cell_iterator =
+    typename Triangulation<dim, spacedim>::active_cell_iterator;
+
+  RadialCellIndex(const Triangulation<dim, spacedim> &triangulation,
+                  const Point<spacedim> &             center,
+                  const double                        tolerance = 1e-10,
+                  const double                        bucket_width = 0.);
+
+  ~RadialCellIndex();
+
+  /**
+   * Return all active cells with at least one vertex at distance @p radius
+   * (up to the tolerance) from the center.
+   */
+  std::vector<active_cell_iterator>
+  cells_touching_sphere(const double radius) const;
+
+  /**
+   * Set the refine flag on all cells returned by cells_touching_sphere(),
+   * and return their number.
+   */
+  unsigned int
+  mark_cells_touching_sphere(const double radius) const;
+
+private:
+  using Key = std::int64_t;
+
+  /**
+   * A cell is identified by its level and index, which stay valid for as
+   * long as the cell exists.
+   */
+  using CellId = std::pair<int, int>;
+
+  Key
+  key(const Point<spacedim> &p) const;
+
+  /**
+   * The ids of the cells in the buckets around @p radius, which have to be
+   * checked exactly.
+   */
+  std::vector<CellId>
+  candidates(const double radius) const;
+
+  bool
+  touches_sphere(const CellId &id, const double radius) const;
+
+  void
+  insert(const cell_iterator &cell);
+
+  void
+  erase(const cell_iterator &cell);
+
+  void
+  rebuild();
+
+  const Triangulation<dim, spacedim> &triangulation;
+  const Point<spacedim>               center;
+  const double                        tolerance;
+  const double                        requested_bucket_width;
+  double                              bucket_width;
+
+  std::unordered_map<Key, std::set<CellId>> buckets;
+
+  std::vector<boost::signals2::connection> connections;
+};
+
+
+
+template <int dim, int spacedim>
+RadialCellIndex<dim, spacedim>::RadialCellIndex(
+  const Triangulation<dim, spacedim> &triangulation,
+  const Point<spacedim> &             center,
+  const double                        tolerance,
+  const double                        bucket_width)
+  : triangulation(triangulation)
+  , center(center)
+  , tolerance(tolerance)
+  , requested_bucket_width(bucket_width)
+  , bucket_width(std::max(bucket_width, 2 * tolerance))
+{
+  connections.push_back(triangulation.signals.post_refinement_on_cell.connect(
+    [this](const cell_iterator &parent) {
+      erase(parent);
+      for (unsigned int c = 0; c < parent->n_children(); ++c)
+        insert(parent->child(c));
+    }));
+  connections.push_back(triangulation.signals.pre_coarsening_on_cell.connect(
+    [this](const cell_iterator &parent) {
+      for (unsigned int c = 0; c < parent->n_children(); ++c)
+        erase(parent->child(c));
+      insert(parent);
+    }));
+  connections.push_back(
+    triangulation.signals.create.connect([this]() { rebuild(); }));
+  connections.push_back(
+    triangulation.signals.clear.connect([this]() { buckets.clear(); }));
+
+  rebuild();
+}
+
+
+
+template <int dim, int spacedim>
+RadialCellIndex<dim, spacedim>::~RadialCellIndex()
+{
+  for (auto &connection : connections)
+    connection.disconnect();
+}
+
+
+
+template <int dim, int spacedim>
+typename RadialCellIndex<dim, spacedim>::Key
+RadialCellIndex<dim, spacedim>::key(const Point<spacedim> &p) const
+{
+  return static_cast<Key>(std::floor(center.distance(p) / bucket_width));
+}
+
+
+
+template <int dim, int spacedim>
+void
+RadialCellIndex<dim, spacedim>::insert(const cell_iterator &cell)
+{
+  for (unsigned int v = 0; v < GeometryInfo<dim>::vertices_per_cell; ++v)
+    buckets[key(cell->vertex(v))].emplace(cell->level(), cell->index());
+}
+
+
+
+template <int dim, int spacedim>
+void
+RadialCellIndex<dim, spacedim>::erase(const cell_iterator &cell)
+{
+  for (unsigned int v = 0; v < GeometryInfo<dim>::vertices_per_cell; ++v)
+    {
+      const auto bucket = buckets.find(key(cell->vertex(v)));
+      if (bucket != buckets.end())
+        {
+          bucket->second.erase(CellId(cell->level(), cell->index()));
+          if (bucket->second.empty())
+            buckets.erase(bucket);
+        }
+    }
+}
+
+
+
+template <int dim, int spacedim>
+void
+RadialCellIndex<dim, spacedim>::rebuild()
+{
+  buckets.clear();
+
+  if (requested_bucket_width == 0.)
+    {
+      double max_distance = 0;
+      for (const auto &vertex : triangulation.get_vertices())
+        max_distance = std::max(max_distance, center.distance(vertex));
+      bucket_width = std::max(max_distance / 1024, 2 * tolerance);
+    }
+
+  std::vector<active_cell_iterator> cells;
+  cells.reserve(triangulation.n_active_cells());
+  for (const auto &cell : triangulation.active_cell_iterators())
+    cells.push_back(cell);
+
+  // The distances are computed in parallel, the buckets filled serially.
+  const unsigned int n_vertices = GeometryInfo<dim>::vertices_per_cell;
+  std::vector<Key>   keys(cells.size() * n_vertices);
+  parallel::apply_to_subranges(
+    0u,
+    static_cast<unsigned int>(cells.size()),
+    [&](const unsigned int begin, const unsigned int end) {
+      for (unsigned int i = begin; i < end; ++i)
+        for (unsigned int v = 0; v < n_vertices; ++v)
+          keys[i * n_vertices + v] = key(cells[i]->vertex(v));
+    },
+    256);
+
+  for (unsigned int i = 0; i < cells.size(); ++i)
+    for (unsigned int v = 0; v < n_vertices; ++v)
+      buckets[keys[i * n_vertices + v]].emplace(cells[i]->level(),
+                                                cells[i]->index());
+}
+
+
+
+template <int dim, int spacedim>
+std::vector<typename RadialCellIndex<dim, spacedim>::CellId>
+RadialCellIndex<dim, spacedim>::candidates(const double radius) const
+{
+  std::set<CellId> ids;
+  const Key first =
+    static_cast<Key>(std::floor((radius - tolerance) / bucket_width));
+  const Key last =
+    static_cast<Key>(std::floor((radius + tolerance) / bucket_width));
+  for (Key k = first; k <= last; ++k)
+    {
+      const auto bucket = buckets.find(k);
+      if (bucket != buckets.end())
+        ids.insert(bucket->second.begin(), bucket->second.end());
+    }
+  return std::vector<CellId>(ids.begin(), ids.end());
+}
+
+
+
+template <int dim, int spacedim>
+bool
+RadialCellIndex<dim, spacedim>::touches_sphere(const CellId &id,
+                                               const double  radius) const
+{
+  const cell_iterator cell(&triangulation, id.first, id.second);
+  for (unsigned int v = 0; v < GeometryInfo<dim>::vertices_per_cell; ++v)
+    if (std::fabs(center.distance(cell->vertex(v)) - radius) < tolerance)
+      return true;
+  return false;
+}
+
+
+
+template <int dim, int spacedim>
+std::vector<typename RadialCellIndex<dim, spacedim>::active_cell_iterator>
+RadialCellIndex<dim, spacedim>::cells_touching_sphere(const double radius) const
+{
+  const std::vector<CellId> ids = candidates(radius);
+
+  // Buckets are wider than the tolerance, so check every candidate exactly.
+  std::vector<char> touches(ids.size(), 0);
+  parallel::apply_to_subranges(
+    0u,
+    static_cast<unsigned int>(ids.size()),
+    [&](const unsigned int begin, const unsigned int end) {
+      for (unsigned int i = begin; i < end; ++i)
+        touches[i] = touches_sphere(ids[i], radius);
+    },
+    64);
+
+  std::vector<active_cell_iterator> cells;
+  for (unsigned int i = 0; i < ids.size(); ++i)
+    if (touches[i])
+      cells.emplace_back(&triangulation, ids[i].first, ids[i].second);
+  return cells;
+}
+
+
+
+template <int dim, int spacedim>
+unsigned int
+RadialCellIndex<dim, spacedim>::mark_cells_touching_sphere(
+  const double radius) const
+{
+  const std::vector<CellId> ids = candidates(radius);
+
+  // Every candidate appears once, and the refine flags are stored in one
+  // byte per cell, so the flags of different cells can be set concurrently.
+  std::vector<char> touches(ids.size(), 0);
+  parallel::apply_to_subranges(
+    0u,
+    static_cast<unsigned int>(ids.size()),
+    [&](const unsigned int begin, const unsigned int end) {
+      for (unsigned int i = begin; i < end; ++i)
+        if (touches_sphere(ids[i], radius))
+          {
+            const active_cell_iterator cell(&triangulation,
+                                            ids[i].first,
+                                            ids[i].second);
+            cell->set_refine_flag();
+            touches[i] = 1;
+          }
+    },
+    64);
+
+  return std::count(touches.begin(), touches.end(), 1);
+}
+
+#endif
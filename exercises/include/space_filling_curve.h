@@ -0,0 +1,181 @@
+#ifndef space_filling_curve_h
+#define space_filling_curve_h
+
+#include <deal.II/base/parallel.h>
+#include <deal.II/base/point.h>
+
+#include <deal.II/dofs/dof_renumbering.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+using namespace dealii;
+
+
+/**
+ * The space filling curves along which cells can be ordered. Cells that are
+ * close on either curve are close in space; the Hilbert curve has the
+ * additional property that consecutive cells are always neighbors, while
+ * the Morton (or Z-order) curve jumps at the boundaries of its quadrants
+ * but is cheaper to evaluate.
+ */
+enum class SpaceFillingCurve
+{
+  hilbert,
+  morton
+};
+
+
+
+/**
+ * The position of the point with integer coordinates @p coordinates, each
+ * between 0 and 2^n_bits - 1, along @p curve. The Hilbert index is computed
+ * with the algorithm of J. Skilling, "Programming the Hilbert curve", AIP
+ * Conference Proceedings 707 (2004), which works in any dimension. The
+ * result fits into 64 bits as long as dim * n_bits <= 64.
+ */
+template <int dim>
+std::uint64_t
+space_filling_curve_index(std::array<std::uint32_t, dim> coordinates,
+                          const unsigned int             n_bits,
+                          const SpaceFillingCurve        curve)
+{
+  Assert(n_bits >= 1 && n_bits <= 32 && dim * n_bits <= 64,
+         ExcMessage("The index does not fit into 64 bits."));
+
+  if (curve == SpaceFillingCurve::hilbert)
+    {
+      // Skilling's AxesToTranspose: first undo the excess work of the
+      // inverse transform...
+      const std::uint32_t m = std::uint32_t(1) << (n_bits - 1);
+      for (std::uint32_t q = m; q > 1; q >>= 1)
+        {
+          const std::uint32_t p = q - 1;
+          for (unsigned int d = 0; d < dim; ++d)
+            if (coordinates[d] & q)
+              coordinates[0] ^= p;
+            else
+              {
+                const std::uint32_t t = (coordinates[0] ^ coordinates[d]) & p;
+                coordinates[0] ^= t;
+                coordinates[d] ^= t;
+              }
+        }
+
+      // ...then Gray encode.
+      for (unsigned int d = 1; d < dim; ++d)
+        coordinates[d] ^= coordinates[d - 1];
+      std::uint32_t t = 0;
+      for (std::uint32_t q = m; q > 1; q >>= 1)
+        if (coordinates[dim - 1] & q)
+          t ^= q - 1;
+      for (unsigned int d = 0; d < dim; ++d)
+        coordinates[d] ^= t;
+    }
+
+  // Both curves end by interleaving the bits of the (transformed)
+  // coordinates, most significant bit first.
+  std::uint64_t index = 0;
+  for (int bit = n_bits - 1; bit >= 0; --bit)
+    for (unsigned int d = 0; d < dim; ++d)
+      index = (index << 1) | ((coordinates[d] >> bit) & 1);
+  return index;
+}
+
+
+
+/**
+ * The active cells of @p dof_handler, sorted by the position of their
+ * centers along @p curve. The centers are scaled to the bounding box of all
+ * centers and rounded to as many bits per coordinate as fit into a 64 bit
+ * index.
+ */
+template <typename DoFHandlerType>
+std::vector<typename DoFHandlerType::active_cell_iterator>
+sort_cells_along_curve(const DoFHandlerType &  dof_handler,
+                       const SpaceFillingCurve curve)
+{
+  constexpr int spacedim = DoFHandlerType::space_dimension;
+  using cell_iterator    = typename DoFHandlerType::active_cell_iterator;
+
+  std::vector<cell_iterator>   cells;
+  std::vector<Point<spacedim>> centers;
+  cells.reserve(dof_handler.get_triangulation().n_active_cells());
+  centers.reserve(dof_handler.get_triangulation().n_active_cells());
+
+  Point<spacedim> lower, upper;
+  for (unsigned int d = 0; d < spacedim; ++d)
+    {
+      lower[d] = std::numeric_limits<double>::max();
+      upper[d] = std::numeric_limits<double>::lowest();
+    }
+  for (const auto &cell : dof_handler.active_cell_iterators())
+    {
+      cells.push_back(cell);
+      centers.push_back(cell->center());
+      for (unsigned int d = 0; d < spacedim; ++d)
+        {
+          lower[d] = std::min(lower[d], centers.back()[d]);
+          upper[d] = std::max(upper[d], centers.back()[d]);
+        }
+    }
+
+  const unsigned int n_bits = std::min(32, 64 / spacedim);
+  const double       n_steps =
+    static_cast<double>((std::uint64_t(1) << n_bits) - 1);
+
+  std::vector<std::pair<std::uint64_t, unsigned int>> keys(cells.size());
+  parallel::apply_to_subranges(
+    0u,
+    static_cast<unsigned int>(cells.size()),
+    [&](const unsigned int begin, const unsigned int end) {
+      for (unsigned int i = begin; i < end; ++i)
+        {
+          std::array<std::uint32_t, spacedim> coordinates;
+          for (unsigned int d = 0; d < spacedim; ++d)
+            coordinates[d] =
+              (upper[d] > lower[d] ?
+                 static_cast<std::uint32_t>((centers[i][d] - lower[d]) /
+                                              (upper[d] - lower[d]) * n_steps +
+                                            0.5) :
+                 0);
+          keys[i] = {space_filling_curve_index<spacedim>(coordinates,
+                                                         n_bits,
+                                                         curve),
+                     i};
+        }
+    },
+    1024);
+
+  std::sort(keys.begin(), keys.end());
+
+  std::vector<cell_iterator> sorted_cells;
+  sorted_cells.reserve(cells.size());
+  for (const auto &key : keys)
+    sorted_cells.push_back(cells[key.second]);
+  return sorted_cells;
+}
+
+
+
+/**
+ * Renumber the degrees of freedom of @p dof_handler cell by cell, with the
+ * cells in the order of @p curve, and return that cell order. Loops over
+ * the returned cells then access the DoFs, and thus the entries of vectors
+ * and matrices, almost sequentially.
+ */
+template <typename DoFHandlerType>
+std::vector<typename DoFHandlerType::active_cell_iterator>
+renumber_along_curve(DoFHandlerType &        dof_handler,
+                     const SpaceFillingCurve curve)
+{
+  const auto cells = sort_cells_along_curve(dof_handler, curve);
+  DoFRenumbering::cell_wise(dof_handler, cells);
+  return cells;
+}
+
+#endif
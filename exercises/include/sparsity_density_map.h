@@ -0,0 +1,160 @@
+#ifndef sparsity_density_map_h
+#define sparsity_density_map_h
+
+#include <deal.II/base/parallel.h>
+
+#include <deal.II/lac/sparsity_pattern.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+using namespace dealii;
+
+
+/**
+ * A downsampled picture of a SparsityPattern. The pattern is divided into
+ * resolution x resolution tiles, and the number of nonzeros in each tile is
+ * counted in one pass over the pattern. Unlike SparsityPattern::print_svg(),
+ * which writes one element per nonzero, the memory and the size of the
+ * output only depend on the resolution, so this also works for patterns
+ * with millions of rows.
+ *
+ * Each row of tiles covers a contiguous range of rows of the pattern, so
+ * the rows of tiles are filled in parallel without any locking.
+ */
+class SparsityDensityMap
+{
+public:
+  SparsityDensityMap(const SparsityPattern &sparsity_pattern,
+                     const unsigned int     resolution = 2048);
+
+  /**
+   * Write the map as a binary greyscale PGM image. Empty tiles are white,
+   * the fullest tile is black, with a logarithmic scale in between so that
+   * sparse off-diagonal tiles remain visible.
+   */
+  void
+  write_pgm(std::ostream &out) const;
+
+  /**
+   * Write, for each row of tiles, the first and last row of the pattern it
+   * covers and the largest distance of a nonzero below and above the
+   * diagonal, as whitespace separated columns for gnuplot.
+   */
+  void
+  write_bandwidth_profile(std::ostream &out) const;
+
+private:
+  const std::size_t  n_rows;
+  const std::size_t  n_cols;
+  const unsigned int n_tile_rows;
+  const unsigned int n_tile_cols;
+
+  std::vector<std::uint32_t> counts;
+  std::vector<std::size_t>   lower_bandwidth;
+  std::vector<std::size_t>   upper_bandwidth;
+
+  std::size_t
+  first_row(const unsigned int tile_row) const;
+};
+
+
+
+inline SparsityDensityMap::SparsityDensityMap(
+  const SparsityPattern &sparsity_pattern,
+  const unsigned int     resolution)
+  : n_rows(sparsity_pattern.n_rows())
+  , n_cols(sparsity_pattern.n_cols())
+  , n_tile_rows(
+      std::max<std::size_t>(1, std::min<std::size_t>(resolution, n_rows)))
+  , n_tile_cols(
+      std::max<std::size_t>(1, std::min<std::size_t>(resolution, n_cols)))
+  , counts(static_cast<std::size_t>(n_tile_rows) * n_tile_cols, 0)
+  , lower_bandwidth(n_tile_rows, 0)
+  , upper_bandwidth(n_tile_rows, 0)
+{
+  Assert(sparsity_pattern.is_compressed(), ExcNotCompressed());
+
+  parallel::apply_to_subranges(
+    0u,
+    n_tile_rows,
+    [&](const unsigned int begin, const unsigned int end) {
+      for (unsigned int tile_row = begin; tile_row < end; ++tile_row)
+        {
+          std::uint32_t *tile_counts =
+            &counts[static_cast<std::size_t>(tile_row) * n_tile_cols];
+          for (std::size_t row = first_row(tile_row);
+               row < first_row(tile_row + 1);
+               ++row)
+            for (auto entry = sparsity_pattern.begin(row);
+                 entry != sparsity_pattern.end(row);
+                 ++entry)
+              {
+                const std::size_t column = entry->column();
+                ++tile_counts[column * n_tile_cols / n_cols];
+                if (column < row)
+                  lower_bandwidth[tile_row] =
+                    std::max(lower_bandwidth[tile_row], row - column);
+                else
+                  upper_bandwidth[tile_row] =
+                    std::max(upper_bandwidth[tile_row], column - row);
+              }
+        }
+    },
+    16);
+}
+
+
+
+inline std::size_t
+SparsityDensityMap::first_row(const unsigned int tile_row) const
+{
+  // The first row r with r * n_tile_rows / n_rows == tile_row, i.e. the
+  // inverse of the mapping from rows to tiles used above.
+  return (static_cast<std::size_t>(tile_row) * n_rows + n_tile_rows - 1) /
+         n_tile_rows;
+}
+
+
+
+inline void
+SparsityDensityMap::write_pgm(std::ostream &out) const
+{
+  const std::uint32_t max_count =
+    counts.empty() ? 0 : *std::max_element(counts.begin(), counts.end());
+  const double scale = (max_count > 0 ? 255. / std::log1p(max_count) : 0.);
+
+  out << "P5\n" << n_tile_cols << ' ' << n_tile_rows << "\n255\n";
+
+  std::vector<char> line(n_tile_cols);
+  for (unsigned int tile_row = 0; tile_row < n_tile_rows; ++tile_row)
+    {
+      for (unsigned int tile_col = 0; tile_col < n_tile_cols; ++tile_col)
+        {
+          const std::uint32_t count =
+            counts[static_cast<std::size_t>(tile_row) * n_tile_cols +
+                   tile_col];
+          line[tile_col] = static_cast<char>(static_cast<unsigned char>(
+            255 - std::lround(scale * std::log1p(count))));
+        }
+      out.write(line.data(), line.size());
+    }
+}
+
+
+
+inline void
+SparsityDensityMap::write_bandwidth_profile(std::ostream &out) const
+{
+  out << "# first_row last_row lower_bandwidth upper_bandwidth" << std::endl;
+  for (unsigned int tile_row = 0; tile_row < n_tile_rows; ++tile_row)
+    if (first_row(tile_row) < first_row(tile_row + 1))
+      out << first_row(tile_row) << ' ' << first_row(tile_row + 1) - 1 << ' '
+          << lower_bandwidth[tile_row] << ' ' << upper_bandwidth[tile_row]
+          << std::endl;
+}
+
+#endif
@@ -0,0 +1,291 @@
+#ifndef sparsity_statistics_h
+#define sparsity_statistics_h
+
+#include <deal.II/base/multithread_info.h>
+#include <deal.II/base/parallel.h>
+
+#include <deal.II/lac/sparsity_pattern.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <vector>
+
+using namespace dealii;
+
+
+/**
+ * Statistics of a SparsityPattern, computed in one parallel pass over its
+ * rows: size, number of nonzeros, bandwidth, profile, row lengths (average
+ * and histogram), fill ratio, density of the diagonal blocks, distribution
+ * of the distances between rows and columns of the nonzeros, and an
+ * estimate of the cache lines a matrix-vector product touches per row.
+ *
+ * The cache line estimate assumes a SparseMatrix<double>: for each row,
+ * the lines of the source vector are the distinct values of
+ * column * sizeof(double) / cache_line_size, and the lines of the matrix are
+ * those of the values and column indices of the row.
+ */
+class SparsityStatistics
+{
+public:
+  SparsityStatistics(const SparsityPattern &sparsity_pattern,
+                     const unsigned int     diagonal_block_size = 64,
+                     const unsigned int     cache_line_size     = 64);
+
+  std::size_t
+  n_nonzero_elements() const;
+
+  std::size_t
+  bandwidth() const;
+
+  double
+  average_row_length() const;
+
+  double
+  fill_ratio() const;
+
+  void
+  write_json(std::ostream &out) const;
+
+private:
+  /**
+   * The statistics of a range of rows. Ranges are processed in parallel,
+   * and their statistics merged at the end.
+   */
+  struct Statistics
+  {
+    void
+    merge(const Statistics &other);
+
+    std::size_t n_nonzero_elements = 0;
+    std::size_t bandwidth          = 0;
+    std::size_t profile            = 0;
+    std::size_t min_row_length     = static_cast<std::size_t>(-1);
+    std::size_t max_row_length     = 0;
+
+    std::map<std::size_t, std::size_t> row_length_histogram;
+
+    std::size_t n_diagonal_block_entries = 0;
+
+    /**
+     * Entry 0 counts nonzeros on the diagonal, entry k those with
+     * 2^(k-1) <= |row - column| < 2^k.
+     */
+    std::vector<std::size_t> distance_histogram;
+
+    std::size_t vector_cache_lines     = 0;
+    std::size_t max_vector_cache_lines = 0;
+    std::size_t matrix_cache_lines     = 0;
+  };
+
+  const std::size_t  n_rows;
+  const std::size_t  n_cols;
+  const unsigned int diagonal_block_size;
+  const unsigned int cache_line_size;
+
+  Statistics statistics;
+};
+
+
+
+inline void
+SparsityStatistics::Statistics::merge(const Statistics &other)
+{
+  n_nonzero_elements += other.n_nonzero_elements;
+  bandwidth = std::max(bandwidth, other.bandwidth);
+  profile += other.profile;
+  min_row_length = std::min(min_row_length, other.min_row_length);
+  max_row_length = std::max(max_row_length, other.max_row_length);
+
+  for (const auto &entry : other.row_length_histogram)
+    row_length_histogram[entry.first] += entry.second;
+
+  n_diagonal_block_entries += other.n_diagonal_block_entries;
+
+  if (distance_histogram.size() < other.distance_histogram.size())
+    distance_histogram.resize(other.distance_histogram.size(), 0);
+  for (unsigned int i = 0; i < other.distance_histogram.size(); ++i)
+    distance_histogram[i] += other.distance_histogram[i];
+
+  vector_cache_lines += other.vector_cache_lines;
+  max_vector_cache_lines =
+    std::max(max_vector_cache_lines, other.max_vector_cache_lines);
+  matrix_cache_lines += other.matrix_cache_lines;
+}
+
+
+
+inline SparsityStatistics::SparsityStatistics(
+  const SparsityPattern &sparsity_pattern,
+  const unsigned int     diagonal_block_size,
+  const unsigned int     cache_line_size)
+  : n_rows(sparsity_pattern.n_rows())
+  , n_cols(sparsity_pattern.n_cols())
+  , diagonal_block_size(diagonal_block_size)
+  , cache_line_size(cache_line_size)
+{
+  Assert(sparsity_pattern.is_compressed(), ExcNotCompressed());
+
+  const std::size_t values_per_line = cache_line_size / sizeof(double);
+  const std::size_t n_chunks = 4 * MultithreadInfo::n_threads();
+  const std::size_t chunk_size = (n_rows + n_chunks - 1) / n_chunks;
+
+  std::vector<Statistics> chunk_statistics(n_chunks);
+  parallel::apply_to_subranges(
+    std::size_t(0),
+    n_chunks,
+    [&](const std::size_t first_chunk, const std::size_t last_chunk) {
+      std::vector<std::size_t> lines;
+      for (std::size_t chunk = first_chunk; chunk < last_chunk; ++chunk)
+        {
+          Statistics &s = chunk_statistics[chunk];
+          for (std::size_t row = chunk * chunk_size;
+               row < std::min(n_rows, (chunk + 1) * chunk_size);
+               ++row)
+            {
+              const std::size_t row_length = sparsity_pattern.row_length(row);
+              s.n_nonzero_elements += row_length;
+              s.min_row_length = std::min(s.min_row_length, row_length);
+              s.max_row_length = std::max(s.max_row_length, row_length);
+              ++s.row_length_histogram[row_length];
+
+              std::size_t first_column = row;
+              lines.clear();
+              for (auto entry = sparsity_pattern.begin(row);
+                   entry != sparsity_pattern.end(row);
+                   ++entry)
+                {
+                  const std::size_t column = entry->column();
+                  const std::size_t distance =
+                    (column > row ? column - row : row - column);
+
+                  s.bandwidth  = std::max(s.bandwidth, distance);
+                  first_column = std::min(first_column, column);
+                  if (row / diagonal_block_size ==
+                      column / diagonal_block_size)
+                    ++s.n_diagonal_block_entries;
+
+                  unsigned int bin = 0;
+                  while ((std::size_t(1) << bin) <= distance)
+                    ++bin;
+                  if (s.distance_histogram.size() <= bin)
+                    s.distance_histogram.resize(bin + 1, 0);
+                  ++s.distance_histogram[bin];
+
+                  lines.push_back(column / values_per_line);
+                }
+              s.profile += row - first_column;
+
+              std::sort(lines.begin(), lines.end());
+              const std::size_t n_lines =
+                std::unique(lines.begin(), lines.end()) - lines.begin();
+              s.vector_cache_lines += n_lines;
+              s.max_vector_cache_lines =
+                std::max(s.max_vector_cache_lines, n_lines);
+
+              // Values and column indices of the row.
+              s.matrix_cache_lines +=
+                (row_length * sizeof(double) + cache_line_size - 1) /
+                  cache_line_size +
+                (row_length * sizeof(SparsityPattern::size_type) +
+                 cache_line_size - 1) /
+                  cache_line_size;
+            }
+        }
+    },
+    1);
+
+  for (const auto &s : chunk_statistics)
+    statistics.merge(s);
+  if (n_rows == 0)
+    statistics.min_row_length = 0;
+}
+
+
+
+inline std::size_t
+SparsityStatistics::n_nonzero_elements() const
+{
+  return statistics.n_nonzero_elements;
+}
+
+
+
+inline std::size_t
+SparsityStatistics::bandwidth() const
+{
+  return statistics.bandwidth;
+}
+
+
+
+inline double
+SparsityStatistics::average_row_length() const
+{
+  return n_rows > 0 ? 1. * statistics.n_nonzero_elements / n_rows : 0.;
+}
+
+
+
+inline double
+SparsityStatistics::fill_ratio() const
+{
+  return n_rows > 0 ? 1. * statistics.n_nonzero_elements / n_rows / n_cols :
+                      0.;
+}
+
+
+
+inline void
+SparsityStatistics::write_json(std::ostream &out) const
+{
+  const std::size_t n_blocks =
+    (n_rows + diagonal_block_size - 1) / diagonal_block_size;
+
+  out << "{" << std::endl
+      << "  \"n_rows\": " << n_rows << "," << std::endl
+      << "  \"n_cols\": " << n_cols << "," << std::endl
+      << "  \"n_nonzero_elements\": " << statistics.n_nonzero_elements << ","
+      << std::endl
+      << "  \"bandwidth\": " << statistics.bandwidth << "," << std::endl
+      << "  \"profile\": " << statistics.profile << "," << std::endl
+      << "  \"fill_ratio\": " << fill_ratio() << "," << std::endl
+      << "  \"row_length\": {\"min\": " << statistics.min_row_length
+      << ", \"max\": " << statistics.max_row_length
+      << ", \"average\": " << average_row_length() << ", \"histogram\": {";
+  for (auto it = statistics.row_length_histogram.begin();
+       it != statistics.row_length_histogram.end();
+       ++it)
+    out << (it != statistics.row_length_histogram.begin() ? ", " : "") << "\""
+        << it->first << "\": " << it->second;
+  out << "}}," << std::endl;
+
+  out << "  \"diagonal_blocks\": {\"size\": " << diagonal_block_size
+      << ", \"fraction_of_nonzeros\": "
+      << (statistics.n_nonzero_elements > 0 ?
+            1. * statistics.n_diagonal_block_entries /
+              statistics.n_nonzero_elements :
+            0.)
+      << ", \"density\": "
+      << (n_blocks > 0 ? 1. * statistics.n_diagonal_block_entries / n_blocks /
+                           diagonal_block_size / diagonal_block_size :
+                         0.)
+      << "}," << std::endl;
+
+  out << "  \"column_distance_log2_histogram\": [";
+  for (unsigned int i = 0; i < statistics.distance_histogram.size(); ++i)
+    out << (i > 0 ? ", " : "") << statistics.distance_histogram[i];
+  out << "]," << std::endl;
+
+  out << "  \"spmv_cache_lines_per_row\": {\"line_size\": " << cache_line_size
+      << ", \"vector_average\": "
+      << (n_rows > 0 ? 1. * statistics.vector_cache_lines / n_rows : 0.)
+      << ", \"vector_max\": " << statistics.max_vector_cache_lines
+      << ", \"matrix_average\": "
+      << (n_rows > 0 ? 1. * statistics.matrix_cache_lines / n_rows : 0.)
+      << "}" << std::endl
+      << "}" << std::endl;
+}
+
+#endif
@@ -0,0 +1,566 @@
+#ifndef symmetric_sparse_matrix_h
+#define symmetric_sparse_matrix_h
+
+#include <deal.II/base/memory_consumption.h>
+#include <deal.II/base/multithread_info.h>
+#include <deal.II/base/parallel.h>
+#include <deal.II/base/subscriptor.h>
+
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/sparsity_pattern.h>
+#include <deal.II/lac/vector.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+
+using namespace dealii;
+
+
+/**
+ * A sparse matrix for symmetric systems that stores only the diagonal and
+ * the upper triangle, in compressed row format with the diagonal first in
+ * each row. Compared to SparseMatrix this halves the memory, and with it
+ * the bytes a matrix-vector product has to read, which is what bounds the
+ * speed of SolverCG on the systems of these exercises.
+ *
+ * The interface is the part of SparseMatrix used by SolverCG,
+ * PreconditionJacobi, PreconditionSSOR and
+ * AffineConstraints::distribute_local_to_global(). Entries below the
+ * diagonal are silently ignored by add(), so that the usual assembly of
+ * full, symmetric cell matrices keeps working unchanged.
+ *
+ * vmult() runs in parallel on contiguous chunks of rows. Row i contributes
+ * a_ij x_j to y_i, which belongs to its chunk, and a_ij x_i to y_j for
+ * j > i, which may belong to a later chunk. The latter go to a buffer of
+ * the chunk, covering the rows from the end of the chunk to its largest
+ * column, that is added to the result afterwards. With a bandwidth reducing
+ * or space filling curve numbering these buffers are small.
+ */
+template <typename number>
+class SymmetricSparseMatrix : public Subscriptor
+{
+public:
+  using size_type  = types::global_dof_index;
+  using value_type = number;
+
+  SymmetricSparseMatrix() = default;
+
+  /**
+   * Set up the storage for the upper triangle of @p sparsity_pattern, which
+   * must be square and symmetric, and set all entries to zero.
+   */
+  void
+  reinit(const SparsityPattern &sparsity_pattern);
+
+  size_type
+  m() const;
+
+  size_type
+  n() const;
+
+  /**
+   * Number of stored entries, i.e. of the diagonal and upper triangle.
+   */
+  std::size_t
+  n_nonzero_elements() const;
+
+  std::size_t
+  memory_consumption() const;
+
+  SymmetricSparseMatrix &
+  operator=(const double d);
+
+  /**
+   * Add @p value to entry (i,j) if j >= i. The entry must be in the
+   * sparsity pattern.
+   */
+  void
+  add(const size_type i, const size_type j, const number value);
+
+  /**
+   * Add the entries of one row, as AffineConstraints does.
+   */
+  template <typename number2>
+  void
+  add(const size_type  row,
+      const size_type  n_cols,
+      const size_type *col_indices,
+      const number2 *  values,
+      const bool       elide_zero_values      = true,
+      const bool       col_indices_are_sorted = false);
+
+  /**
+   * Add a full cell matrix with the given global indices.
+   */
+  template <typename number2>
+  void
+  add(const std::vector<size_type> &indices,
+      const FullMatrix<number2> &   full_matrix,
+      const bool                    elide_zero_values = true);
+
+  /**
+   * Entry (i,j), or zero if it is not stored. Both triangles can be read.
+   */
+  number
+  el(const size_type i, const size_type j) const;
+
+  number
+  diag_element(const size_type i) const;
+
+  template <typename somenumber>
+  void
+  vmult(Vector<somenumber> &dst, const Vector<somenumber> &src) const;
+
+  template <typename somenumber>
+  void
+  Tvmult(Vector<somenumber> &dst, const Vector<somenumber> &src) const;
+
+  template <typename somenumber>
+  void
+  precondition_Jacobi(Vector<somenumber> &      dst,
+                      const Vector<somenumber> &src,
+                      const number              omega = 1.) const;
+
+  /**
+   * Apply the SSOR preconditioner. The forward sweep needs the strictly
+   * lower triangle by rows, which is the stored upper triangle by columns:
+   * it is done in "push" form, scattering each solved unknown into the
+   * later rows. The last argument is only there for compatibility with
+   * PreconditionSSOR, which passes the positions of the first entries right
+   * of the diagonal of a SparseMatrix.
+   */
+  template <typename somenumber>
+  void
+  precondition_SSOR(Vector<somenumber> &            dst,
+                    const Vector<somenumber> &      src,
+                    const number                    omega = 1.,
+                    const std::vector<std::size_t> &pos_right_of_diagonal =
+                      std::vector<std::size_t>()) const;
+
+  /**
+   * Impose the values @p boundary_values like
+   * MatrixTools::apply_boundary_values() with eliminate_columns == true,
+   * which keeps the matrix symmetric: the rows and columns of these DoFs
+   * are zeroed except for the diagonal, and the columns are moved to the
+   * right hand side.
+   */
+  template <typename somenumber>
+  void
+  apply_boundary_values(
+    const std::map<size_type, somenumber> &boundary_values,
+    Vector<somenumber> &                   solution,
+    Vector<somenumber> &                   right_hand_side);
+
+private:
+  std::size_t
+  find(const size_type i, const size_type j) const;
+
+  size_type n_rows = 0;
+
+  std::vector<std::size_t> row_start;
+  std::vector<size_type>   columns;
+  std::vector<number>      values;
+
+  /**
+   * The first row of each chunk of vmult(), plus n_rows at the end, and one
+   * past the largest column of each chunk.
+   */
+  std::vector<size_type> chunk_start;
+  std::vector<size_type> chunk_column_end;
+};
+
+
+
+template <typename number>
+inline void
+SymmetricSparseMatrix<number>::reinit(const SparsityPattern &sparsity_pattern)
+{
+  Assert(sparsity_pattern.n_rows() == sparsity_pattern.n_cols(),
+         ExcNotQuadratic());
+  Assert(sparsity_pattern.is_compressed(), ExcNotCompressed());
+
+  n_rows = sparsity_pattern.n_rows();
+  row_start.assign(n_rows + 1, 0);
+  for (size_type row = 0; row < n_rows; ++row)
+    {
+      std::size_t n_upper = 0;
+      for (auto entry = sparsity_pattern.begin(row);
+           entry != sparsity_pattern.end(row);
+           ++entry)
+        if (entry->column() >= row)
+          ++n_upper;
+      row_start[row + 1] = row_start[row] + n_upper;
+    }
+
+  columns.resize(row_start.back());
+  for (size_type row = 0; row < n_rows; ++row)
+    {
+      std::size_t k = row_start[row];
+      for (auto entry = sparsity_pattern.begin(row);
+           entry != sparsity_pattern.end(row);
+           ++entry)
+        if (entry->column() >= row)
+          columns[k++] = entry->column();
+      std::sort(columns.begin() + row_start[row], columns.begin() + k);
+      Assert(k > row_start[row] && columns[row_start[row]] == row,
+             ExcMessage("The sparsity pattern must contain the diagonal."));
+    }
+  values.assign(columns.size(), number());
+
+  // Chunks with about the same number of entries, a few per thread.
+  const std::size_t n_chunks = std::max<std::size_t>(
+    1, std::min<std::size_t>(4 * MultithreadInfo::n_threads(), n_rows / 1024));
+  chunk_start.assign(1, 0);
+  chunk_column_end.clear();
+  for (std::size_t c = 1; c <= n_chunks; ++c)
+    {
+      size_type end = chunk_start.back();
+      if (c == n_chunks)
+        end = n_rows;
+      else
+        while (end < n_rows && row_start[end] * n_chunks < c * columns.size())
+          ++end;
+
+      size_type column_end = end;
+      for (size_type row = chunk_start.back(); row < end; ++row)
+        if (row_start[row + 1] > row_start[row])
+          column_end =
+            std::max(column_end, columns[row_start[row + 1] - 1] + 1);
+
+      chunk_start.push_back(end);
+      chunk_column_end.push_back(column_end);
+    }
+}
+
+
+
+template <typename number>
+inline typename SymmetricSparseMatrix<number>::size_type
+SymmetricSparseMatrix<number>::m() const
+{
+  return n_rows;
+}
+
+
+
+template <typename number>
+inline typename SymmetricSparseMatrix<number>::size_type
+SymmetricSparseMatrix<number>::n() const
+{
+  return n_rows;
+}
+
+
+
+template <typename number>
+inline std::size_t
+SymmetricSparseMatrix<number>::n_nonzero_elements() const
+{
+  return values.size();
+}
+
+
+
+template <typename number>
+inline std::size_t
+SymmetricSparseMatrix<number>::memory_consumption() const
+{
+  return sizeof(*this) + MemoryConsumption::memory_consumption(row_start) +
+         MemoryConsumption::memory_consumption(columns) +
+         MemoryConsumption::memory_consumption(values) +
+         MemoryConsumption::memory_consumption(chunk_start) +
+         MemoryConsumption::memory_consumption(chunk_column_end);
+}
+
+
+
+template <typename number>
+inline SymmetricSparseMatrix<number> &
+SymmetricSparseMatrix<number>::operator=(const double d)
+{
+  (void)d;
+  Assert(d == 0, ExcScalarAssignmentOnlyForZeroValue());
+  std::fill(values.begin(), values.end(), number());
+  return *this;
+}
+
+
+
+template <typename number>
+inline std::size_t
+SymmetricSparseMatrix<number>::find(const size_type i, const size_type j) const
+{
+  AssertIndexRange(i, n_rows);
+  const auto begin = columns.begin() + row_start[i];
+  const auto end   = columns.begin() + row_start[i + 1];
+  const auto p     = std::lower_bound(begin, end, j);
+  return (p != end && *p == j) ? p - columns.begin() :
+                                 numbers::invalid_size_type;
+}
+
+
+
+template <typename number>
+inline void
+SymmetricSparseMatrix<number>::add(const size_type i,
+                                   const size_type j,
+                                   const number    value)
+{
+  if (j < i || value == number())
+    return;
+
+  const std::size_t k = find(i, j);
+  Assert(k != numbers::invalid_size_type,
+         ExcMessage("The entry is not in the sparsity pattern."));
+  values[k] += value;
+}
+
+
+
+template <typename number>
+template <typename number2>
+inline void
+SymmetricSparseMatrix<number>::add(const size_type  row,
+                                   const size_type  n_cols,
+                                   const size_type *col_indices,
+                                   const number2 *  values,
+                                   const bool       elide_zero_values,
+                                   const bool       col_indices_are_sorted)
+{
+  if (!col_indices_are_sorted)
+    {
+      for (size_type c = 0; c < n_cols; ++c)
+        if (!elide_zero_values || values[c] != number2())
+          add(row, col_indices[c], static_cast<number>(values[c]));
+      return;
+    }
+
+  // Sorted columns: merge them with the stored ones of the row.
+  std::size_t k = row_start[row];
+  for (size_type c =
+         std::lower_bound(col_indices, col_indices + n_cols, row) - col_indices;
+       c < n_cols;
+       ++c)
+    {
+      if (elide_zero_values && values[c] == number2())
+        continue;
+      while (k < row_start[row + 1] && columns[k] < col_indices[c])
+        ++k;
+      Assert(k < row_start[row + 1] && columns[k] == col_indices[c],
+             ExcMessage("The entry is not in the sparsity pattern."));
+      this->values[k] += values[c];
+    }
+}
+
+
+
+template <typename number>
+template <typename number2>
+inline void
+SymmetricSparseMatrix<number>::add(const std::vector<size_type> &indices,
+                                   const FullMatrix<number2> &   full_matrix,
+                                   const bool elide_zero_values)
+{
+  AssertDimension(indices.size(), full_matrix.m());
+  AssertDimension(indices.size(), full_matrix.n());
+  for (unsigned int i = 0; i < indices.size(); ++i)
+    for (unsigned int j = 0; j < indices.size(); ++j)
+      if (!elide_zero_values || full_matrix(i, j) != number2())
+        add(indices[i], indices[j], static_cast<number>(full_matrix(i, j)));
+}
+
+
+
+template <typename number>
+inline number
+SymmetricSparseMatrix<number>::el(const size_type i, const size_type j) const
+{
+  const std::size_t k = (i <= j ? find(i, j) : find(j, i));
+  return k != numbers::invalid_size_type ? values[k] : number();
+}
+
+
+
+template <typename number>
+inline number
+SymmetricSparseMatrix<number>::diag_element(const size_type i) const
+{
+  AssertIndexRange(i, n_rows);
+  return values[row_start[i]];
+}
+
+
+
+template <typename number>
+template <typename somenumber>
+inline void
+SymmetricSparseMatrix<number>::vmult(Vector<somenumber> &      dst,
+                                     const Vector<somenumber> &src) const
+{
+  AssertDimension(dst.size(), n_rows);
+  AssertDimension(src.size(), n_rows);
+  Assert(&src != &dst, ExcSourceEqualsDestination());
+
+  const unsigned int n_chunks = chunk_column_end.size();
+  std::vector<std::vector<somenumber>> transpose_buffers(n_chunks);
+
+  parallel::apply_to_subranges(
+    0u,
+    n_chunks,
+    [&](const unsigned int first_chunk, const unsigned int last_chunk) {
+      for (unsigned int c = first_chunk; c < last_chunk; ++c)
+        {
+          const size_type begin = chunk_start[c];
+          const size_type end   = chunk_start[c + 1];
+          std::vector<somenumber> &buffer = transpose_buffers[c];
+          buffer.assign(chunk_column_end[c] - end, somenumber());
+
+          for (size_type row = begin; row < end; ++row)
+            dst(row) = somenumber();
+          for (size_type row = begin; row < end; ++row)
+            {
+              const somenumber x_row = src(row);
+              std::size_t      k     = row_start[row];
+              somenumber       sum   = values[k] * x_row;
+              for (++k; k < row_start[row + 1]; ++k)
+                {
+                  const size_type column = columns[k];
+                  sum += values[k] * src(column);
+                  if (column < end)
+                    dst(column) += values[k] * x_row;
+                  else
+                    buffer[column - end] += values[k] * x_row;
+                }
+              dst(row) += sum;
+            }
+        }
+    },
+    1);
+
+  for (unsigned int c = 0; c < n_chunks; ++c)
+    for (std::size_t i = 0; i < transpose_buffers[c].size(); ++i)
+      dst(chunk_start[c + 1] + i) += transpose_buffers[c][i];
+}
+
+
+
+template <typename number>
+template <typename somenumber>
+inline void
+SymmetricSparseMatrix<number>::Tvmult(Vector<somenumber> &      dst,
+                                      const Vector<somenumber> &src) const
+{
+  vmult(dst, src);
+}
+
+
+
+template <typename number>
+template <typename somenumber>
+inline void
+SymmetricSparseMatrix<number>::precondition_Jacobi(
+  Vector<somenumber> &      dst,
+  const Vector<somenumber> &src,
+  const number              omega) const
+{
+  AssertDimension(dst.size(), n_rows);
+  AssertDimension(src.size(), n_rows);
+  for (size_type row = 0; row < n_rows; ++row)
+    dst(row) = omega * src(row) / values[row_start[row]];
+}
+
+
+
+template <typename number>
+template <typename somenumber>
+inline void
+SymmetricSparseMatrix<number>::precondition_SSOR(
+  Vector<somenumber> &      dst,
+  const Vector<somenumber> &src,
+  const number              omega,
+  const std::vector<std::size_t> &) const
+{
+  AssertDimension(dst.size(), n_rows);
+  AssertDimension(src.size(), n_rows);
+
+  // Solve (D/omega + L) y = src, with L = U^T.
+  dst = src;
+  for (size_type row = 0; row < n_rows; ++row)
+    {
+      const somenumber y = dst(row) * omega / values[row_start[row]];
+      dst(row)           = y;
+      for (std::size_t k = row_start[row] + 1; k < row_start[row + 1]; ++k)
+        dst(columns[k]) -= values[k] * y;
+    }
+
+  // Multiply by (2-omega)/omega D.
+  for (size_type row = 0; row < n_rows; ++row)
+    dst(row) *= (2. - omega) / omega * values[row_start[row]];
+
+  // Solve (D/omega + U) dst = y.
+  for (size_type row = n_rows; row-- > 0;)
+    {
+      somenumber sum = 0;
+      for (std::size_t k = row_start[row] + 1; k < row_start[row + 1]; ++k)
+        sum += values[k] * dst(columns[k]);
+      dst(row) = (dst(row) - sum) * omega / values[row_start[row]];
+    }
+}
+
+
+
+template <typename number>
+template <typename somenumber>
+inline void
+SymmetricSparseMatrix<number>::apply_boundary_values(
+  const std::map<size_type, somenumber> &boundary_values,
+  Vector<somenumber> &                   solution,
+  Vector<somenumber> &                   right_hand_side)
+{
+  if (boundary_values.empty())
+    return;
+
+  std::vector<bool> is_boundary(n_rows, false);
+  Vector<somenumber> g(n_rows);
+  for (const auto &value : boundary_values)
+    {
+      is_boundary[value.first] = true;
+      g(value.first)           = value.second;
+    }
+
+  // A diagonal entry for rows whose own diagonal is zero.
+  number first_nonzero_diagonal = 1.;
+  for (size_type row = 0; row < n_rows; ++row)
+    if (values[row_start[row]] != number())
+      {
+        first_nonzero_diagonal = std::abs(values[row_start[row]]);
+        break;
+      }
+
+  for (size_type row = 0; row < n_rows; ++row)
+    {
+      for (std::size_t k = row_start[row] + 1; k < row_start[row + 1]; ++k)
+        {
+          const size_type column = columns[k];
+          if (is_boundary[column] && !is_boundary[row])
+            right_hand_side(row) -= values[k] * g(column);
+          else if (is_boundary[row] && !is_boundary[column])
+            right_hand_side(column) -= values[k] * g(row);
+          if (is_boundary[row] || is_boundary[column])
+            values[k] = number();
+        }
+
+      if (is_boundary[row])
+        {
+          number &diagonal = values[row_start[row]];
+          if (diagonal == number())
+            diagonal = first_nonzero_diagonal;
+          right_hand_side(row) = diagonal * g(row);
+          solution(row)        = g(row);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef triangulation_cache_h
+#define triangulation_cache_h
+
+#include <deal.II/base/config.h>
+
+#include <deal.II/base/exceptions.h>
+#include <deal.II/base/geometry_info.h>
+
+#include <deal.II/grid/manifold.h>
+#include <deal.II/grid/tria.h>
+#include <deal.II/grid/tria_accessor.h>
+#include <deal.II/grid/tria_iterator.h>
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+
+using namespace dealii;
+
+
+/**
+ * A content-addressed on-disk cache of refined triangulations.
+ *
+ * The cache key is a hash of the coarse mesh (vertex coordinates, cell
+ * connectivity, material, boundary and manifold ids) together with a string
+ * describing everything else that determines the refined mesh, i.e., the
+ * sequence of refinement steps and the manifolds attached to the
+ * triangulation. The refined triangulation is stored in binary form in a file
+ * whose name is derived from the key, so that a second run with identical
+ * inputs can load it instead of repeating the refinement.
+ *
+ * Manifold objects are not part of the serialized data: the ones attached
+ * to the triangulation before a cache hit are attached again after loading.
+ */
+class TriangulationCache
+{
+public:
+  /**
+   * How to use the cache: read and write it, ignore it completely, or
+   * ignore existing entries but overwrite them with freshly computed ones.
+   */
+  enum class Mode
+  {
+    use,
+    bypass,
+    refresh
+  };
+
+  /**
+   * Return Mode::bypass if `--no-cache` and Mode::refresh if
+   * `--refresh-cache` is among the command line arguments, and Mode::use
+   * otherwise.
+   */
+  static Mode
+  mode_from_command_line(int argc, char **argv);
+
+  TriangulationCache(const Mode mode = Mode::use);
+
+  /**
+   * Bring @p triangulation from its current state to the refined state
+   * described by @p refinement_history, either by loading it from the cache
+   * or by calling @p refine and storing the result. Return true if the
+   * triangulation was loaded from the cache.
+   */
+  template <int dim, int spacedim>
+  bool
+  refine(Triangulation<dim, spacedim> &triangulation,
+         const std::string &           refinement_history,
+         const std::function<void()> & refine) const;
+
+  /**
+   * Return the key under which the refinement of @p triangulation described by
+   * @p refinement_history is stored. Only the coarse level of the
+   * triangulation enters the key.
+   */
+  template <int dim, int spacedim>
+  static std::string
+  key(const Triangulation<dim, spacedim> &triangulation,
+      const std::string &                 refinement_history);
+
+private:
+  /**
+   * A small FNV-1a hash: unlike std::hash, its value is guaranteed to be the
+   * same across runs and compilers.
+   */
+  class Hash
+  {
+  public:
+    template <typename T>
+    void
+    add(const T &value);
+
+    void
+    add(const std::string &value);
+
+    std::uint64_t
+    value() const;
+
+  private:
+    std::uint64_t h = 14695981039346656037ull;
+  };
+
+  const Mode mode;
+};
+
+
+
+inline TriangulationCache::Mode
+TriangulationCache::mode_from_command_line(int argc, char **argv)
+{
+  Mode mode = Mode::use;
+  for (int i = 1; i < argc; ++i)
+    if (std::string(argv[i]) == "--no-cache")
+      mode = Mode::bypass;
+    else if (std::string(argv[i]) == "--refresh-cache")
+      mode = Mode::refresh;
+  return mode;
+}
+
+
+
+inline TriangulationCache::TriangulationCache(const Mode mode)
+  : mode(mode)
+{}
+
+
+
+template <typename T>
+inline void
+TriangulationCache::Hash::add(const T &value)
+{
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&value);
+  for (unsigned int i = 0; i < sizeof(T); ++i)
+    {
+      h ^= bytes[i];
+      h *= 1099511628211ull;
+    }
+}
+
+
+
+inline void
+TriangulationCache::Hash::add(const std::string &value)
+{
+  for (const char c : value)
+    add(c);
+  add(value.size());
+}
+
+
+
+inline std::uint64_t
+TriangulationCache::Hash::value() const
+{
+  return h;
+}
+
+
+
+template <int dim, int spacedim>
+std::string
+TriangulationCache::key(const Triangulation<dim, spacedim> &triangulation,
+                        const std::string &                 refinement_history)
+{
+  Hash hash;
+  hash.add(std::string(DEAL_II_PACKAGE_VERSION));
+  hash.add(dim);
+  hash.add(spacedim);
+  hash.add(triangulation.n_cells(0));
+
+  for (auto cell = triangulation.begin(0); cell != triangulation.end(0); ++cell)
+    {
+      for (unsigned int v = 0; v < GeometryInfo<dim>::vertices_per_cell; ++v)
+        {
+          hash.add(cell->vertex_index(v));
+          for (unsigned int d = 0; d < spacedim; ++d)
+            hash.add(cell->vertex(v)[d]);
+        }
+      hash.add(cell->material_id());
+      hash.add(cell->manifold_id());
+
+      if (dim > 1)
+        for (unsigned int f = 0; f < GeometryInfo<dim>::faces_per_cell; ++f)
+          {
+            hash.add(cell->face(f)->boundary_id());
+            hash.add(cell->face(f)->manifold_id());
+          }
+      if (dim > 2)
+        for (unsigned int l = 0; l < GeometryInfo<dim>::lines_per_cell; ++l)
+          {
+            hash.add(cell->line(l)->boundary_id());
+            hash.add(cell->line(l)->manifold_id());
+          }
+    }
+
+  hash.add(refinement_history);
+
+  std::ostringstream name;
+  name << "tria-cache-" << dim << 'd' << spacedim << "-" << std::hex
+       << std::setw(16) << std::setfill('0') << hash.value() << ".bin";
+  return name.str();
+}
+
+
+
+template <int dim, int spacedim>
+bool
+TriangulationCache::refine(Triangulation<dim, spacedim> &triangulation,
+                           const std::string &           refinement_history,
+                           const std::function<void()> & refine) const
+{
+  const std::string filename = key(triangulation, refinement_history);
+
+  if (mode == Mode::use)
+    {
+      std::ifstream in(filename, std::ios::binary);
+      if (in)
+        {
+          // Remember the manifolds: they are not serialized, and loading
+          // clears the triangulation.
+          std::map<types::manifold_id, std::unique_ptr<Manifold<dim, spacedim>>>
+            manifolds;
+          for (const auto id : triangulation.get_manifold_ids())
+            if (id != numbers::flat_manifold_id)
+              manifolds[id] = triangulation.get_manifold(id).clone();
+
+          // A failed load leaves the triangulation in an unusable state, so
+          // there is nothing to fall back to: ask for a fresh entry instead.
+          try
+            {
+              boost::archive::binary_iarchive archive(in);
+              archive >> triangulation;
+            }
+          catch (const std::exception &exc)
+            {
+              AssertThrow(false,
+                          ExcMessage("The cache entry " + filename +
+                                     " could not be read (" + exc.what() +
+                                     "). Run again with --refresh-cache."));
+            }
+
+          for (const auto &manifold : manifolds)
+            triangulation.set_manifold(manifold.first, *manifold.second);
+          return true;
+        }
+    }
+
+  refine();
+
+  if (mode != Mode::bypass)
+    {
+      std::ofstream out(filename, std::ios::binary);
+      if (out)
+        {
+          boost::archive::binary_oarchive archive(out);
+          archive << triangulation;
+        }
+    }
+
+  return false;
+}
+
+#endif
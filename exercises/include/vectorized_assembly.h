@@ -0,0 +1,225 @@
+#ifndef vectorized_assembly_h
+#define vectorized_assembly_h
+
+#include <deal.II/base/aligned_vector.h>
+#include <deal.II/base/exceptions.h>
+#include <deal.II/base/point.h>
+#include <deal.II/base/tensor.h>
+#include <deal.II/base/types.h>
+#include <deal.II/base/vectorization.h>
+
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/vector.h>
+
+#include <assembly_kernels.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace dealii;
+
+
+/**
+ * The start indices of the batches of @p n_lanes consecutive cells into a
+ * list of @p n_cells cells. The last batch may be partially filled.
+ */
+inline std::vector<unsigned int>
+make_cell_batches(const unsigned int n_cells, const unsigned int n_lanes)
+{
+  std::vector<unsigned int> batches;
+  for (unsigned int first = 0; first < n_cells; first += n_lanes)
+    batches.push_back(first);
+  return batches;
+}
+
+
+
+/**
+ * The LaplaceKernel for batches of cells: each lane of @p Number holds one
+ * cell, so the Jacobians, the real gradients and the cell matrices of as
+ * many cells as there are SIMD lanes are computed with the same
+ * instructions. The results are then split up cell by cell, to be scattered
+ * into the global matrix as usual.
+ *
+ * The right hand side is a function of the real quadrature points, which is
+ * evaluated lane by lane.
+ */
+template <int dim,
+          int degree,
+          int n_q_points_1d,
+          typename Number = VectorizedArray<double>>
+class BatchedLaplaceKernel : public LaplaceKernel<dim, degree, n_q_points_1d>
+{
+public:
+  using Base = LaplaceKernel<dim, degree, n_q_points_1d>;
+
+#if DEAL_II_VERSION_GTE(9, 2, 0)
+  static constexpr unsigned int n_lanes = Number::size();
+#else
+  static constexpr unsigned int n_lanes = Number::n_array_elements;
+#endif
+
+  using Base::dofs_per_cell;
+  using Base::n_q_points;
+  using Base::n_vertices;
+
+  /**
+   * The buffers of compute(), one per thread.
+   */
+  struct ScratchData
+  {
+    ScratchData();
+
+    AlignedVector<Number> matrix;
+    AlignedVector<Number> rhs;
+    AlignedVector<Number> real_gradients;
+  };
+
+  /**
+   * The cell matrices, right hand sides and DoF indices of one batch.
+   */
+  struct CopyData
+  {
+    CopyData();
+
+    unsigned int                                      n_cells;
+    std::vector<FullMatrix<double>>                   cell_matrices;
+    std::vector<Vector<double>>                       cell_rhs;
+    std::vector<std::vector<types::global_dof_index>> local_dof_indices;
+  };
+
+  /**
+   * Compute the cell matrices and right hand sides of the @p n_cells cells
+   * starting at @p cells, where @p n_cells is at most n_lanes.
+   */
+  template <typename CellIterator, typename RightHandSide>
+  void
+  compute(const CellIterator * cells,
+          const unsigned int   n_cells,
+          const RightHandSide &rhs_function,
+          ScratchData &        scratch,
+          CopyData &           copy_data) const;
+};
+
+
+
+template <int dim, int degree, int n_q_points_1d, typename Number>
+constexpr unsigned int
+  BatchedLaplaceKernel<dim, degree, n_q_points_1d, Number>::n_lanes;
+
+
+
+template <int dim, int degree, int n_q_points_1d, typename Number>
+BatchedLaplaceKernel<dim, degree, n_q_points_1d, Number>::ScratchData::
+  ScratchData()
+  : matrix(dofs_per_cell * dofs_per_cell)
+  , rhs(dofs_per_cell)
+  , real_gradients(dim * dofs_per_cell)
+{}
+
+
+
+template <int dim, int degree, int n_q_points_1d, typename Number>
+BatchedLaplaceKernel<dim, degree, n_q_points_1d, Number>::CopyData::CopyData()
+  : n_cells(0)
+  , cell_matrices(n_lanes, FullMatrix<double>(dofs_per_cell, dofs_per_cell))
+  , cell_rhs(n_lanes, Vector<double>(dofs_per_cell))
+  , local_dof_indices(n_lanes,
+                      std::vector<types::global_dof_index>(dofs_per_cell))
+{}
+
+
+
+template <int dim, int degree, int n_q_points_1d, typename Number>
+template <typename CellIterator, typename RightHandSide>
+void
+BatchedLaplaceKernel<dim, degree, n_q_points_1d, Number>::compute(
+  const CellIterator * cells,
+  const unsigned int   n_cells,
+  const RightHandSide &rhs_function,
+  ScratchData &        scratch,
+  CopyData &           copy_data) const
+{
+  Assert(n_cells >= 1 && n_cells <= n_lanes,
+         ExcIndexRange(n_cells, 1, n_lanes + 1));
+
+  // Empty lanes repeat the last cell, so that their Jacobians are
+  // invertible. Their results are never copied out.
+  Point<dim, Number> vertices[n_vertices];
+  for (unsigned int lane = 0; lane < n_lanes; ++lane)
+    {
+      const CellIterator &cell = cells[std::min(lane, n_cells - 1)];
+      for (unsigned int v = 0; v < n_vertices; ++v)
+        for (unsigned int d = 0; d < dim; ++d)
+          vertices[v][d][lane] = cell->vertex(v)[d];
+    }
+
+  Number *const matrix         = scratch.matrix.begin();
+  Number *const rhs            = scratch.rhs.begin();
+  Number *const real_gradients = scratch.real_gradients.begin();
+  std::fill(scratch.matrix.begin(), scratch.matrix.end(), Number());
+  std::fill(scratch.rhs.begin(), scratch.rhs.end(), Number());
+
+  for (unsigned int q = 0; q < n_q_points; ++q)
+    {
+      Point<dim, Number>     x;
+      Tensor<2, dim, Number> jacobian;
+      for (unsigned int v = 0; v < n_vertices; ++v)
+        for (unsigned int d = 0; d < dim; ++d)
+          {
+            x[d] += vertices[v][d] * this->vertex_values[q][v];
+            for (unsigned int e = 0; e < dim; ++e)
+              jacobian[d][e] +=
+                vertices[v][d] * this->vertex_gradients[q][e][v];
+          }
+
+      const Number JxW = this->weights[q] * determinant(jacobian);
+
+      const Tensor<2, dim, Number> inverse = invert(jacobian);
+
+      for (unsigned int d = 0; d < dim; ++d)
+        for (unsigned int i = 0; i < dofs_per_cell; ++i)
+          {
+            Number sum = Number();
+            for (unsigned int e = 0; e < dim; ++e)
+              sum += inverse[e][d] * this->gradients[q][e][i];
+            real_gradients[d * dofs_per_cell + i] = sum;
+          }
+
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+        for (unsigned int j = 0; j < dofs_per_cell; ++j)
+          {
+            Number sum = Number();
+            for (unsigned int d = 0; d < dim; ++d)
+              sum += real_gradients[d * dofs_per_cell + i] *
+                     real_gradients[d * dofs_per_cell + j];
+            matrix[i * dofs_per_cell + j] += JxW * sum;
+          }
+
+      Number rhs_values = Number();
+      for (unsigned int lane = 0; lane < n_cells; ++lane)
+        {
+          Point<dim> p;
+          for (unsigned int d = 0; d < dim; ++d)
+            p[d] = x[d][lane];
+          rhs_values[lane] = rhs_function.value(p);
+        }
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+        rhs[i] += this->values[q][i] * rhs_values * JxW;
+    }
+
+  copy_data.n_cells = n_cells;
+  for (unsigned int lane = 0; lane < n_cells; ++lane)
+    {
+      for (unsigned int i = 0; i < dofs_per_cell; ++i)
+        {
+          for (unsigned int j = 0; j < dofs_per_cell; ++j)
+            copy_data.cell_matrices[lane](i, j) =
+              matrix[i * dofs_per_cell + j][lane];
+          copy_data.cell_rhs[lane](i) = rhs[i][lane];
+        }
+      cells[lane]->get_dof_indices(copy_data.local_dof_indices[lane]);
+    }
+}
+
+#endif
@@ -0,0 +1,266 @@
+// Throughput of mesh generation and refinement for the shell meshes of
+// step-1: uniform refinement as in first_grid(), and refinement towards the
+// inner boundary as in second_grid(), for dim = 2 and 3 and an increasing
+// number of threads. One CSV line is written per refinement step.
+//
+// Every combination of dim, mode and number of threads runs in a process of
+// its own, started by the driver in main(), so that the peak memory column,
+// the high water mark of the process, belongs to that run alone.
+
+
+#include <deal.II/base/multithread_info.h>
+#include <deal.II/base/timer.h>
+#include <deal.II/base/utilities.h>
+
+#include <deal.II/grid/grid_generator.h>
+#include <deal.II/grid/manifold_lib.h>
+#include <deal.II/grid/tria.h>
+#include <deal.II/grid/tria_accessor.h>
+#include <deal.II/grid/tria_iterator.h>
+
+#include <radial_cell_index.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <unistd.h>
+
+using namespace dealii;
+
+
+/**
+ * A SphericalManifold that accumulates the time spent computing new points.
+ * Triangulations store clones of their manifolds, so all clones share the
+ * same counter.
+ */
+template <int dim>
+class TimedSphericalManifold : public SphericalManifold<dim>
+{
+public:
+  TimedSphericalManifold(const Point<dim> &center)
+    : SphericalManifold<dim>(center)
+    , nanoseconds(std::make_shared<std::atomic<std::int64_t>>(0))
+  {}
+
+  virtual std::unique_ptr<Manifold<dim>>
+  clone() const override
+  {
+    return std::unique_ptr<Manifold<dim>>(
+      new TimedSphericalManifold<dim>(*this));
+  }
+
+  virtual Point<dim>
+  get_intermediate_point(const Point<dim> &p1,
+                         const Point<dim> &p2,
+                         const double      w) const override
+  {
+    const Scope scope(*nanoseconds);
+    return SphericalManifold<dim>::get_intermediate_point(p1, p2, w);
+  }
+
+  virtual Point<dim>
+  get_new_point(const ArrayView<const Point<dim>> &vertices,
+                const ArrayView<const double> &   weights) const override
+  {
+    const Scope scope(*nanoseconds);
+    return SphericalManifold<dim>::get_new_point(vertices, weights);
+  }
+
+  virtual void
+  get_new_points(const ArrayView<const Point<dim>> &surrounding_points,
+                 const Table<2, double> &           weights,
+                 ArrayView<Point<dim>>              new_points) const override
+  {
+    const Scope scope(*nanoseconds);
+    SphericalManifold<dim>::get_new_points(surrounding_points,
+                                           weights,
+                                           new_points);
+  }
+
+  /**
+   * Return the accumulated time in seconds, and reset it.
+   */
+  double
+  pop_time() const
+  {
+    return nanoseconds->exchange(0) * 1e-9;
+  }
+
+private:
+  /**
+   * Add the lifetime of this object to a counter. The SphericalManifold
+   * functions above may call each other, in which case only the outermost
+   * call is counted.
+   */
+  class Scope
+  {
+  public:
+    Scope(std::atomic<std::int64_t> &counter)
+      : counter(counter)
+      , outermost(depth++ == 0)
+      , start(std::chrono::steady_clock::now())
+    {}
+
+    ~Scope()
+    {
+      --depth;
+      if (outermost)
+        counter += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+    }
+
+  private:
+    static thread_local unsigned int depth;
+
+    std::atomic<std::int64_t> &                 counter;
+    const bool                                  outermost;
+    const std::chrono::steady_clock::time_point start;
+  };
+
+  std::shared_ptr<std::atomic<std::int64_t>> nanoseconds;
+};
+
+template <int dim>
+thread_local unsigned int TimedSphericalManifold<dim>::Scope::depth = 0;
+
+
+
+/**
+ * Write one CSV line for a refinement step that produced the current
+ * state of @p triangulation in @p time seconds. The peak memory is the
+ * high water mark of the process, which only runs the current mode.
+ */
+template <int dim>
+void
+write_row(std::ostream &                     out,
+          const std::string &                mode,
+          const unsigned int                 n_threads,
+          const unsigned int                 step,
+          const Triangulation<dim> &         triangulation,
+          const double                       time,
+          const TimedSphericalManifold<dim> &manifold)
+{
+  Utilities::System::MemoryStats stats;
+  Utilities::System::get_memory_stats(stats);
+
+  out << dim << ',' << mode << ',' << n_threads << ',' << step << ','
+      << triangulation.n_active_cells() << ',' << time << ','
+      << triangulation.n_active_cells() / time << ',' << manifold.pop_time()
+      << ',' << stats.VmHWM << std::endl;
+}
+
+
+
+/**
+ * Run one mode, "uniform" as in first_grid() or "adaptive" as in
+ * second_grid(), and append its rows to @p out.
+ */
+template <int dim>
+void
+benchmark(std::ostream &     out,
+          const std::string &mode,
+          const unsigned int n_threads,
+          const unsigned int n_steps)
+{
+  const Point<dim> center;
+  const double     inner_radius = 0.5, outer_radius = 1.0;
+
+  const TimedSphericalManifold<dim> manifold(center);
+
+  Triangulation<dim> triangulation;
+  Timer              timer;
+  GridGenerator::hyper_shell(triangulation, center, inner_radius, outer_radius);
+  triangulation.set_manifold(0, manifold);
+
+  // The index is only needed, and only updated on refinement, in the
+  // adaptive mode.
+  std::unique_ptr<RadialCellIndex<dim>> index;
+  if (mode == "adaptive")
+    index.reset(new RadialCellIndex<dim>(triangulation, center));
+
+  write_row(
+    out, mode, n_threads, 0, triangulation, timer.wall_time(), manifold);
+
+  for (unsigned int step = 1; step <= n_steps; ++step)
+    {
+      timer.restart();
+      if (mode == "uniform")
+        triangulation.refine_global(1);
+      else
+        {
+          index->mark_cells_touching_sphere(inner_radius);
+          triangulation.execute_coarsening_and_refinement();
+        }
+      write_row(
+        out, mode, n_threads, step, triangulation, timer.wall_time(), manifold);
+    }
+}
+
+
+
+int
+main(int argc, char **argv)
+{
+  const std::string filename = "refinement-benchmark.csv";
+
+  // A single run, started by the driver below: --run dim mode n_threads.
+  if (argc == 5 && std::string(argv[1]) == "--run")
+    {
+      const unsigned int dim       = Utilities::string_to_int(argv[2]);
+      const std::string  mode      = argv[3];
+      const unsigned int n_threads = Utilities::string_to_int(argv[4]);
+      MultithreadInfo::set_thread_limit(n_threads);
+
+      std::ofstream out(filename, std::ios::app);
+      if (dim == 2)
+        benchmark<2>(out, mode, n_threads, mode == "uniform" ? 8 : 12);
+      else
+        benchmark<3>(out, mode, n_threads, mode == "uniform" ? 4 : 6);
+      return 0;
+    }
+
+  // The maximum number of threads can be given on the command line; it
+  // defaults to the number of cores.
+  const unsigned int max_threads =
+    (argc > 1 ? Utilities::string_to_int(argv[1]) :
+                MultithreadInfo::n_cores());
+
+  {
+    std::ofstream out(filename);
+    out << "dim,mode,n_threads,step,n_active_cells,time,cells_per_second,"
+        << "manifold_time,process_peak_memory_kb" << std::endl;
+  }
+
+  // argv[0] is not a path to the executable if it was found in the PATH or
+  // started relative to another directory. /proc/self/exe links to it, and
+  // has to be resolved here: in the shell of std::system() it would name
+  // the shell.
+  char       buffer[4096];
+  const auto length = readlink("/proc/self/exe", buffer, sizeof(buffer) - 1);
+  AssertThrow(length > 0,
+              ExcMessage("Cannot find the executable in /proc/self/exe."));
+  const std::string executable(buffer, length);
+
+  for (unsigned int n_threads = 1; n_threads <= max_threads; ++n_threads)
+    {
+      std::cout << "Running with " << n_threads << " thread(s)" << std::endl;
+      for (const unsigned int dim : {2, 3})
+        for (const std::string mode : {"uniform", "adaptive"})
+          {
+            const std::string command = "\"" + executable + "\" --run " +
+                                        std::to_string(dim) + " " + mode +
+                                        " " + std::to_string(n_threads);
+            AssertThrow(std::system(command.c_str()) == 0,
+                        ExcMessage("The run \"" + command + "\" failed."));
+          }
+    }
+
+  std::cout << "Results written to " << filename << std::endl;
+}
@@ -16,6 +16,11 @@
  */
 
 
+#include <deal.II/base/data_out_base.h>
+#include <deal.II/base/thread_management.h>
+#include <deal.II/base/timer.h>
+#include <deal.II/base/utilities.h>
+
 #include <deal.II/grid/grid_generator.h>
 #include <deal.II/grid/grid_out.h>
 #include <deal.II/grid/manifold_lib.h>
@@ -23,15 +28,225 @@
 #include <deal.II/grid/tria_accessor.h>
 #include <deal.II/grid/tria_iterator.h>
 
+#include <cached_manifold.h>
+#include <mesh_statistics.h>
+#include <radial_cell_index.h>
+#include <triangulation_cache.h>
+
 #include <cmath>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
 
 using namespace dealii;
 
 
+/**
+ * Write snapshots of a Triangulation to zlib-compressed binary vtu files on a
+ * background thread.
+ *
+ * write() copies the triangulation and returns immediately, so that the
+ * caller can keep refining while the previous snapshot is being written. At
+ * most one write is in flight at any time: a new call to write() first waits
+ * for the previous one, which keeps the memory held by snapshots bounded to a
+ * single copy of the mesh.
+ */
+template <int dim>
+class AsyncGridWriter
+{
+public:
+  AsyncGridWriter(const DataOutBase::VtkFlags::ZlibCompressionLevel
+                    compression_level = DataOutBase::VtkFlags::best_speed);
+
+  ~AsyncGridWriter();
+
+  void
+  write(const Triangulation<dim> &triangulation, const std::string &filename);
+
+  void
+  wait();
+
+private:
+  GridOutFlags::Vtu flags;
+
+  std::unique_ptr<Triangulation<dim>> snapshot;
+
+  Threads::Task<> task;
+};
+
+
+template <int dim>
+AsyncGridWriter<dim>::AsyncGridWriter(
+  const DataOutBase::VtkFlags::ZlibCompressionLevel compression_level)
+{
+  flags.compression_level = compression_level;
+}
+
+
+template <int dim>
+AsyncGridWriter<dim>::~AsyncGridWriter()
+{
+  wait();
+}
+
+
+template <int dim>
+void
+AsyncGridWriter<dim>::write(const Triangulation<dim> &triangulation,
+                            const std::string &       filename)
+{
+  wait();
+
+  snapshot.reset(new Triangulation<dim>());
+  snapshot->copy_triangulation(triangulation);
+
+  task = Threads::new_task([this, filename]() {
+    std::ofstream out(filename);
+    GridOut       grid_out;
+    grid_out.set_flags(flags);
+    grid_out.write_vtu(*snapshot, out);
+  });
+}
+
+
+template <int dim>
+void
+AsyncGridWriter<dim>::wait()
+{
+  if (task.joinable())
+    task.join();
+  snapshot.reset();
+}
+
+
+
+/**
+ * Print the resident and peak resident set size of this process, together
+ * with the memory used by @p triangulation.
+ */
+template <int dim>
+void
+print_memory_usage(const std::string &       label,
+                   const Triangulation<dim> &triangulation)
+{
+  Utilities::System::MemoryStats stats;
+  Utilities::System::get_memory_stats(stats);
+
+  std::cout << label << ": RSS " << stats.VmRSS / 1024 << " MB, peak RSS "
+            << stats.VmHWM / 1024 << " MB, triangulation "
+            << triangulation.memory_consumption() / 1024 / 1024 << " MB"
+            << std::endl;
+}
+
+
+
+/**
+ * Replace @p triangulation by a coarse mesh made of its active cells, and
+ * release all coarser levels.
+ *
+ * Material ids and the boundary and manifold ids of cells, faces and (in 3d)
+ * lines are preserved, and the manifolds attached to the triangulation are
+ * attached again. Coarse meshes cannot have hanging nodes, so meshes that
+ * have them are left untouched, and false is returned.
+ */
+template <int dim>
+bool
+flatten_to_active_cells(Triangulation<dim> &triangulation)
+{
+  if (triangulation.has_hanging_nodes())
+    {
+      std::cout << "Cannot flatten a triangulation with hanging nodes."
+                << std::endl;
+      return false;
+    }
+
+  print_memory_usage("Before flattening", triangulation);
+
+  std::map<types::manifold_id, std::unique_ptr<Manifold<dim>>> manifolds;
+  for (const auto id : triangulation.get_manifold_ids())
+    if (id != numbers::flat_manifold_id)
+      manifolds[id] = triangulation.get_manifold(id).clone();
+
+  std::vector<Point<dim>>    vertices;
+  std::vector<unsigned int>  new_vertex_indices(triangulation.n_vertices(),
+                                               numbers::invalid_unsigned_int);
+  std::vector<CellData<dim>> cells;
+  SubCellData                subcell_data;
+  std::set<unsigned int>     visited_lines, visited_quads;
+
+  const auto vertex_index = [&](const unsigned int old_index) {
+    if (new_vertex_indices[old_index] == numbers::invalid_unsigned_int)
+      {
+        new_vertex_indices[old_index] = vertices.size();
+        vertices.push_back(triangulation.get_vertices()[old_index]);
+      }
+    return new_vertex_indices[old_index];
+  };
+
+  for (const auto &cell : triangulation.active_cell_iterators())
+    {
+      CellData<dim> cell_data;
+      for (unsigned int v = 0; v < GeometryInfo<dim>::vertices_per_cell; ++v)
+        cell_data.vertices[v] = vertex_index(cell->vertex_index(v));
+      cell_data.material_id = cell->material_id();
+      cell_data.manifold_id = cell->manifold_id();
+      cells.push_back(cell_data);
+
+      // Only boundary objects, and interior ones that carry a manifold id,
+      // need to be described explicitly.
+      if (dim > 1)
+        for (unsigned int l = 0; l < GeometryInfo<dim>::lines_per_cell; ++l)
+          {
+            const auto line = cell->line(l);
+            if ((line->at_boundary() ||
+                 line->manifold_id() != numbers::flat_manifold_id) &&
+                visited_lines.insert(line->index()).second)
+              {
+                CellData<1> line_data;
+                for (unsigned int v = 0; v < 2; ++v)
+                  line_data.vertices[v] = vertex_index(line->vertex_index(v));
+                line_data.boundary_id = line->boundary_id();
+                line_data.manifold_id = line->manifold_id();
+                subcell_data.boundary_lines.push_back(line_data);
+              }
+          }
+
+      if (dim > 2)
+        for (unsigned int f = 0; f < GeometryInfo<dim>::faces_per_cell; ++f)
+          {
+            const auto face = cell->face(f);
+            if ((face->at_boundary() ||
+                 face->manifold_id() != numbers::flat_manifold_id) &&
+                visited_quads.insert(face->index()).second)
+              {
+                CellData<2> quad_data;
+                for (unsigned int v = 0; v < 4; ++v)
+                  quad_data.vertices[v] = vertex_index(face->vertex_index(v));
+                quad_data.boundary_id = face->boundary_id();
+                quad_data.manifold_id = face->manifold_id();
+                subcell_data.boundary_quads.push_back(quad_data);
+              }
+          }
+    }
+  new_vertex_indices.clear();
+
+  triangulation.clear();
+  triangulation.create_triangulation(vertices, cells, subcell_data);
+  for (const auto &manifold : manifolds)
+    triangulation.set_manifold(manifold.first, *manifold.second);
+
+  print_memory_usage("After flattening", triangulation);
+  return true;
+}
+
+
+
 void
-first_grid()
+first_grid(const TriangulationCache::Mode cache_mode, const bool flatten)
 {
   Triangulation<2> triangulation;
 
@@ -50,52 +265,92 @@ first_grid()
         cell->set_all_manifold_ids(50);
     }
 
-  triangulation.set_manifold(50, manifold);
+  // New points are computed in parallel before each refinement, and served
+  // from the cache during the refinement itself.
+  const CachedManifold<2> cached_manifold(manifold);
+  triangulation.set_manifold(50, cached_manifold);
 
   const unsigned int ref_level = 7;
 
+  // Level i is written in the background while level i+1 is being built, so
+  // that each step costs max(refine, write) instead of their sum.
+  Timer                    timer;
+  AsyncGridWriter<2>       writer;
+  const TriangulationCache cache(cache_mode);
+  MeshStatistics<2>        statistics(triangulation);
+
+  std::ofstream statistics_csv("grid_statistics.csv");
+  MeshStatistics<2>::write_csv_header(statistics_csv);
+
   for (unsigned int i = 0; i < ref_level; ++i)
     {
-      std::ofstream out("grid_" + std::to_string(i) + ".vtu");
-      GridOut       grid_out;
-      grid_out.write_vtu(triangulation, out);
-      triangulation.refine_global(1);
+      writer.write(triangulation, "grid_" + std::to_string(i) + ".vtu");
+      // A flattened triangulation has its last active level as coarse
+      // mesh, so that it is always one refinement away from the next one.
+      cache.refine(triangulation,
+                   "refine_global(" + std::to_string(flatten ? 1 : i + 1) +
+                     "), SphericalManifold(origin) on id 50",
+                   [&]() {
+                     triangulation.set_all_refine_flags();
+                     prefetch_refinement_points(triangulation);
+                     triangulation.execute_coarsening_and_refinement();
+                     cached_manifold.clear();
+                   });
+
+      statistics.write_csv_row(statistics_csv);
+
+      if (flatten)
+        flatten_to_active_cells(triangulation);
     }
+  writer.wait();
+
+  statistics.print_summary(std::cout);
+  std::ofstream statistics_json("grid_statistics.json");
+  statistics.write_json(statistics_json);
+
+  std::cout << "Refined and wrote " << ref_level << " levels in "
+            << timer.wall_time() << " s" << std::endl;
 }
 
 
 
 template <int dim = 2>
 void
-second_grid()
+second_grid(const TriangulationCache::Mode cache_mode, const bool flatten)
 {
   Triangulation<dim> triangulation;
 
   const Point<dim> center;
   const double     inner_radius = 0.5, outer_radius = 1.0;
   GridGenerator::hyper_shell(triangulation, center, inner_radius, outer_radius);
-  for (unsigned int step = 0; step < 5; ++step)
-    {
-      for (auto &cell : triangulation.active_cell_iterators())
-        //        for (const auto &v : cell->vertex_iterators())
-        {
-          for (unsigned int v = 0; v < GeometryInfo<dim>::vertices_per_cell;
-               ++v)
-            {
-              const double distance_from_center =
-                center.distance(cell->vertex(v));
-
-              if (std::fabs(distance_from_center - inner_radius) < 1e-10)
-                {
-                  cell->set_refine_flag();
-                  break;
-                }
-            }
-        }
-
-      triangulation.execute_coarsening_and_refinement();
-    }
 
+  // The index follows the refinement of the triangulation, so finding the
+  // cells on the inner boundary costs time proportional to their number.
+  // Neither is const: both update themselves from the signals of the
+  // triangulation.
+  RadialCellIndex<dim> index(triangulation, center);
+  MeshStatistics<dim>  statistics(triangulation);
+
+  const unsigned int n_steps = 5;
+  const auto         refine  = [&]() {
+    for (unsigned int step = 0; step < n_steps; ++step)
+      {
+        index.mark_cells_touching_sphere(inner_radius);
+        triangulation.execute_coarsening_and_refinement();
+      }
+  };
+
+  TriangulationCache(cache_mode)
+    .refine(triangulation,
+            std::to_string(n_steps) + " steps refining at r=" +
+              std::to_string(inner_radius) +
+              ", default hyper_shell manifolds",
+            refine);
+
+  // The adaptive refinement above leaves hanging nodes, so this only reports
+  // that the hierarchy has to be kept.
+  if (flatten)
+    flatten_to_active_cells(triangulation);
 
   for (auto cell : triangulation.active_cell_iterators())
     {
@@ -114,13 +369,27 @@ second_grid()
   grid_out.write_vtk(triangulation, out);
 
   std::cout << "Grid written to grid-2.vtk" << std::endl;
+
+  statistics.print_summary(std::cout);
+  std::ofstream statistics_json("grid-2-statistics.json");
+  statistics.write_json(statistics_json);
 }
 
 
 
 int
-main()
+main(int argc, char **argv)
 {
-  first_grid();
-  // second_grid<2>();
+  // Pass --no-cache to ignore the mesh cache, or --refresh-cache to rebuild
+  // its entries. Pass --flatten to keep only the active cells of the meshes
+  // after each refinement.
+  const auto cache_mode = TriangulationCache::mode_from_command_line(argc, argv);
+
+  bool flatten = false;
+  for (int i = 1; i < argc; ++i)
+    if (std::string(argv[i]) == "--flatten")
+      flatten = true;
+
+  first_grid(cache_mode, flatten);
+  // second_grid<2>(cache_mode, flatten);
 }
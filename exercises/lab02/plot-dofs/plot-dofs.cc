@@ -30,18 +30,82 @@
 
 #include <deal.II/numerics/data_out.h>
 
+#include <patch_cache.h>
+
 #include <cmath>
 #include <fstream>
 #include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
 
 using namespace dealii;
 
 
-int main()
+/**
+ * Write each basis function to its own file, basis-<i>.vtu, together with
+ * a time series basis.pvd that steps through them. Each file only contains
+ * the cells in the support of its basis function, and the same vector is
+ * reused for all of them, so memory is linear in the number of DoFs and the
+ * run time proportional to the total size of the supports. The mapped
+ * patches are computed once by the PatchCache and shared by all files.
+ */
+template <int dim>
+void
+write_basis_functions(const DoFHandler<dim> &     dh,
+                      const Mapping<dim> &        mapping,
+                      const unsigned int          degree,
+                      const DataOutBase::VtkFlags flags)
+{
+  // The support of each basis function, as active cell indices.
+  std::vector<std::vector<unsigned int>> support(dh.n_dofs());
+  std::vector<types::global_dof_index>   local_dof_indices(
+    dh.get_fe().dofs_per_cell);
+  for (const auto &cell : dh.active_cell_iterators())
+    {
+      cell->get_dof_indices(local_dof_indices);
+      for (const auto dof : local_dof_indices)
+        support[dof].push_back(cell->active_cell_index());
+    }
+
+  Vector<double> basis_function(dh.n_dofs());
+
+  PatchCache<dim> patch_cache(dh, mapping, degree);
+  patch_cache.add_data_vector(basis_function, "basis_function");
+
+  std::vector<std::pair<double, std::string>> times_and_names;
+  for (types::global_dof_index i = 0; i < dh.n_dofs(); ++i)
+    {
+      const std::string filename = "basis-" + std::to_string(i) + ".vtu";
+      std::ofstream     out(filename);
+
+      basis_function[i] = 1;
+      patch_cache.write_vtu(out, flags, support[i]);
+      basis_function[i] = 0;
+
+      times_and_names.emplace_back(i, filename);
+    }
+
+  std::ofstream pvd("basis.pvd");
+  DataOutBase::write_pvd_record(pvd, times_and_names);
+}
+
+
+
+// Without arguments, every basis function gets its own file. With
+// --single-file, all of them are written to solution.vtk as fields on the
+// whole mesh instead, which takes memory quadratic in the number of DoFs and
+// is only usable for very coarse meshes.
+int main(int argc, char **argv)
 {
   const int dim    = 2;
   const int degree = 2;
 
+  bool single_file = false;
+  for (int i = 1; i < argc; ++i)
+    if (std::string(argv[i]) == "--single-file")
+      single_file = true;
+
   Triangulation<dim> triangulation;
 
   FE_Q<dim>            fe(degree);
@@ -52,17 +116,24 @@ int main()
 
   dh.distribute_dofs(fe);
 
-  std::vector<Vector<double>> solution(dh.n_dofs(),
-                                       Vector<double>(dh.n_dofs()));
-
-  DataOut<dim>          data_out;
   DataOutBase::VtkFlags flags;
   flags.write_higher_order_cells = true;
-  data_out.set_flags(flags);
 
   std::cout << "Dofs: " << dh.n_dofs() << std::endl;
   std::cout << "Vertices: " << triangulation.n_vertices() << std::endl;
 
+  if (!single_file)
+    {
+      write_basis_functions(dh, mapping, degree, flags);
+      return 0;
+    }
+
+  std::vector<Vector<double>> solution(dh.n_dofs(),
+                                       Vector<double>(dh.n_dofs()));
+
+  DataOut<dim> data_out;
+  data_out.set_flags(flags);
+
   std::ofstream out("solution.vtk");
 
   data_out.attach_dof_handler(dh);
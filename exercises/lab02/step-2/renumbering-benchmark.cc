@@ -0,0 +1,174 @@
+// Bandwidth reduction versus cost of the DoFRenumbering schemes of lab02:
+// for increasing refinement levels, dim = 2, 3 and FE_Q degrees 1 to 3, time
+// each renumbering and record the bandwidth and profile of the resulting
+// sparsity pattern, and the time of a matrix-vector product with a
+// SparseMatrix built on it. All results end up in one table.
+
+
+#include <deal.II/base/table_handler.h>
+#include <deal.II/base/timer.h>
+
+#include <deal.II/dofs/dof_handler.h>
+#include <deal.II/dofs/dof_renumbering.h>
+#include <deal.II/dofs/dof_tools.h>
+
+#include <deal.II/fe/fe_q.h>
+
+#include <deal.II/grid/grid_generator.h>
+#include <deal.II/grid/manifold_lib.h>
+#include <deal.II/grid/tria.h>
+
+#include <deal.II/lac/dynamic_sparsity_pattern.h>
+#include <deal.II/lac/sparse_matrix.h>
+#include <deal.II/lac/sparsity_pattern.h>
+#include <deal.II/lac/vector.h>
+
+#include <space_filling_curve.h>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace dealii;
+
+
+/**
+ * The profile (or envelope) of a sparsity pattern: the sum over all rows of
+ * the distance between the diagonal and the leftmost entry of the row.
+ */
+unsigned long long int
+profile(const SparsityPattern &sparsity_pattern)
+{
+  unsigned long long int profile = 0;
+  for (unsigned int row = 0; row < sparsity_pattern.n_rows(); ++row)
+    {
+      types::global_dof_index first_column = row;
+      for (auto entry = sparsity_pattern.begin(row);
+           entry != sparsity_pattern.end(row);
+           ++entry)
+        first_column = std::min<types::global_dof_index>(first_column,
+                                                         entry->column());
+      profile += row - first_column;
+    }
+  return profile;
+}
+
+
+
+/**
+ * Average wall time of one SparseMatrix::vmult() on @p sparsity_pattern.
+ */
+double
+spmv_time(const SparsityPattern &sparsity_pattern)
+{
+  SparseMatrix<double> matrix(sparsity_pattern);
+  for (unsigned int row = 0; row < matrix.m(); ++row)
+    for (auto entry = matrix.begin(row); entry != matrix.end(row); ++entry)
+      entry->value() = (entry->column() == row ? 4. : -1.);
+
+  Vector<double> src(matrix.n()), dst(matrix.m());
+  src = 1.;
+
+  const unsigned int n_repetitions = 20;
+  Timer              timer;
+  for (unsigned int i = 0; i < n_repetitions; ++i)
+    matrix.vmult(dst, src);
+  return timer.wall_time() / n_repetitions;
+}
+
+
+
+template <int dim>
+void
+benchmark(TableHandler &     table,
+          const unsigned int degree,
+          const unsigned int n_refinements)
+{
+  const std::vector<
+    std::pair<std::string, std::function<void(DoFHandler<dim> &)>>>
+    schemes = {
+      {"none", [](DoFHandler<dim> &) {}},
+      {"Cuthill_McKee",
+       [](DoFHandler<dim> &dh) { DoFRenumbering::Cuthill_McKee(dh); }},
+      {"reverse_Cuthill_McKee",
+       [](DoFHandler<dim> &dh) { DoFRenumbering::Cuthill_McKee(dh, true); }},
+      {"king_ordering",
+       [](DoFHandler<dim> &dh) { DoFRenumbering::boost::king_ordering(dh); }},
+      {"minimum_degree",
+       [](DoFHandler<dim> &dh) {
+         DoFRenumbering::boost::minimum_degree(dh);
+       }},
+      {"component_wise",
+       [](DoFHandler<dim> &dh) { DoFRenumbering::component_wise(dh); }},
+      {"hilbert",
+       [](DoFHandler<dim> &dh) {
+         renumber_along_curve(dh, SpaceFillingCurve::hilbert);
+       }},
+      {"morton",
+       [](DoFHandler<dim> &dh) {
+         renumber_along_curve(dh, SpaceFillingCurve::morton);
+       }}};
+
+  Triangulation<dim> triangulation;
+  GridGenerator::hyper_shell(triangulation, Point<dim>(), 0.5, 1.0);
+  triangulation.refine_global(n_refinements);
+
+  const FE_Q<dim> fe(degree);
+  DoFHandler<dim> dof_handler(triangulation);
+
+  for (const auto &scheme : schemes)
+    {
+      // Start from the same numbering for every scheme.
+      dof_handler.distribute_dofs(fe);
+
+      Timer timer;
+      scheme.second(dof_handler);
+      const double renumbering_time = timer.wall_time();
+
+      DynamicSparsityPattern dsp(dof_handler.n_dofs());
+      DoFTools::make_sparsity_pattern(dof_handler, dsp);
+      SparsityPattern sparsity_pattern;
+      sparsity_pattern.copy_from(dsp);
+
+      table.add_value("dim", dim);
+      table.add_value("degree", degree);
+      table.add_value("level", n_refinements);
+      table.add_value("n_dofs", dof_handler.n_dofs());
+      table.add_value("scheme", scheme.first);
+      table.add_value("time", renumbering_time);
+      table.add_value("bandwidth", sparsity_pattern.bandwidth());
+      table.add_value("profile", profile(sparsity_pattern));
+      table.add_value("spmv_time", spmv_time(sparsity_pattern));
+
+      std::cout << dim << "d, Q" << degree << ", level " << n_refinements
+                << ", " << scheme.first << " done" << std::endl;
+    }
+}
+
+
+
+int
+main()
+{
+  TableHandler table;
+
+  for (unsigned int degree = 1; degree <= 3; ++degree)
+    {
+      for (unsigned int level = 2; level <= 6; ++level)
+        benchmark<2>(table, degree, level);
+      for (unsigned int level = 1; level <= 3; ++level)
+        benchmark<3>(table, degree, level);
+    }
+
+  table.set_scientific("time", true);
+  table.set_scientific("spmv_time", true);
+
+  table.write_text(std::cout, TableHandler::org_mode_table);
+
+  std::ofstream out("renumbering-benchmark.txt");
+  table.write_text(out);
+}
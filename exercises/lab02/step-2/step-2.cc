@@ -20,6 +20,11 @@
  */
 
 
+#include <deal.II/base/parallel.h>
+#include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/timer.h>
+#include <deal.II/base/utilities.h>
+
 #include <deal.II/grid/tria.h>
 #include <deal.II/grid/tria_accessor.h>
 #include <deal.II/grid/tria_iterator.h>
@@ -29,18 +34,36 @@
 #include <deal.II/dofs/dof_handler.h>
 
 #include <deal.II/fe/fe_q.h>
+#include <deal.II/fe/fe_values.h>
 #include <deal.II/dofs/dof_tools.h>
 #include <deal.II/lac/sparse_matrix.h>
 #include <deal.II/lac/dynamic_sparsity_pattern.h>
+#include <deal.II/lac/affine_constraints.h>
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/vector.h>
 
 #include <deal.II/dofs/dof_renumbering.h>
 
+#include <cached_manifold.h>
+#include <direct_sparsity_builder.h>
+#include <sparsity_density_map.h>
+#include <space_filling_curve.h>
+#include <sparsity_statistics.h>
+#include <triangulation_cache.h>
+
+#include <algorithm>
+#include <functional>
+#include <utility>
 #include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
 
 using namespace dealii;
 
 
-void make_grid (Triangulation<2> &triangulation)
+void make_grid (Triangulation<2> &triangulation,
+                const TriangulationCache::Mode cache_mode)
 {
   const Point<2> center (1,0);
   const double inner_radius = 0.5,
@@ -50,80 +73,412 @@ void make_grid (Triangulation<2> &triangulation)
                               5 );
 
   static const SphericalManifold<2> manifold_description(center);
+  static const CachedManifold<2> cached_manifold(manifold_description);
   triangulation.set_all_manifold_ids(0);
-  triangulation.set_manifold (0, manifold_description);
+  triangulation.set_manifold (0, cached_manifold);
+
+  const unsigned int n_steps = 3;
+  const auto refine = [&] ()
+  {
+    for (unsigned int step=0; step<n_steps; ++step)
+      {
+        Triangulation<2>::active_cell_iterator
+        cell = triangulation.begin_active(),
+        endc = triangulation.end();
+
+        for (; cell!=endc; ++cell)
+          for (unsigned int v=0;
+               v < GeometryInfo<2>::vertices_per_cell;
+               ++v)
+            {
+              const double distance_from_center
+                = center.distance (cell->vertex(v));
+
+              if (std::fabs(distance_from_center - inner_radius) < 1e-10)
+                {
+                  cell->set_refine_flag ();
+                  break;
+                }
+            }
+
+        prefetch_refinement_points (triangulation);
+        triangulation.execute_coarsening_and_refinement ();
+        cached_manifold.clear ();
+      }
+  };
+
+  TriangulationCache(cache_mode)
+  .refine (triangulation,
+           std::to_string(n_steps) + " steps refining at r=" +
+           std::to_string(inner_radius) +
+           ", SphericalManifold(1,0) on id 0",
+           refine);
+}
 
-  for (unsigned int step=0; step<3; ++step)
+
+// SparsityPattern::print_svg() writes one element per nonzero, which
+// produces files no browser can open once there are more than a few tens
+// of thousands of DoFs. Beyond that size we therefore write a fixed
+// resolution density map as a PGM image instead, together with the
+// bandwidth profile of the pattern.
+void write_sparsity_pattern (const SparsityPattern &sparsity_pattern,
+                             const std::string &basename)
+{
+  const unsigned int max_n_rows_for_svg = 20000;
+
+  if (sparsity_pattern.n_rows() <= max_n_rows_for_svg)
     {
-      Triangulation<2>::active_cell_iterator
-      cell = triangulation.begin_active(),
-      endc = triangulation.end();
-
-      for (; cell!=endc; ++cell)
-        for (unsigned int v=0;
-             v < GeometryInfo<2>::vertices_per_cell;
-             ++v)
-          {
-            const double distance_from_center
-              = center.distance (cell->vertex(v));
-
-            if (std::fabs(distance_from_center - inner_radius) < 1e-10)
-              {
-                cell->set_refine_flag ();
-                break;
-              }
-          }
+      std::ofstream out (basename + ".svg");
+      sparsity_pattern.print_svg (out);
+    }
+  else
+    {
+      const SparsityDensityMap density_map (sparsity_pattern);
+
+      std::ofstream out (basename + ".pgm", std::ios::binary);
+      density_map.write_pgm (out);
 
-      triangulation.execute_coarsening_and_refinement ();
+      std::ofstream profile (basename + "-bandwidth.txt");
+      density_map.write_bandwidth_profile (profile);
     }
 }
 
 
-void distribute_dofs (DoFHandler<2> &dof_handler)
+
+void distribute_dofs (DoFHandler<2> &dof_handler,
+                      SparsityPattern &sparsity_pattern)
 {
   static const FE_Q<2> finite_element(1);
   dof_handler.distribute_dofs (finite_element);
 
-  DynamicSparsityPattern dynamic_sparsity_pattern(dof_handler.n_dofs(),
-                                                  dof_handler.n_dofs());
+  build_sparsity_pattern (dof_handler, sparsity_pattern);
+
+  write_sparsity_pattern (sparsity_pattern, "sparsity_pattern1");
+}
 
-  DoFTools::make_sparsity_pattern (dof_handler, dynamic_sparsity_pattern);
 
-  SparsityPattern sparsity_pattern;
-  sparsity_pattern.copy_from (dynamic_sparsity_pattern);
 
-  std::ofstream out ("sparsity_pattern1.svg");
-  sparsity_pattern.print_svg (out);
+// Renumbering the DoFs does not change which DoFs couple, only their
+// names. Instead of building the sparsity pattern again from the mesh, we
+// therefore rename the rows and columns of the existing one. Every row is
+// written by exactly one thread, so this costs O(nnz) and runs in parallel.
+void permute_sparsity_pattern (const SparsityPattern &sparsity_pattern,
+                               const std::vector<types::global_dof_index> &new_numbers,
+                               SparsityPattern &permuted_sparsity_pattern)
+{
+  const types::global_dof_index n = sparsity_pattern.n_rows();
+  Assert (sparsity_pattern.n_cols() == n, ExcNotQuadratic());
+  AssertDimension (new_numbers.size(), n);
+
+  std::vector<types::global_dof_index> old_numbers (n);
+  for (types::global_dof_index i=0; i<n; ++i)
+    old_numbers[new_numbers[i]] = i;
+
+  std::vector<unsigned int> row_lengths (n);
+  for (types::global_dof_index row=0; row<n; ++row)
+    row_lengths[row] = sparsity_pattern.row_length (old_numbers[row]);
+
+  permuted_sparsity_pattern.reinit (n, n, row_lengths);
+
+  parallel::apply_to_subranges
+  (types::global_dof_index (0), n,
+   [&] (const types::global_dof_index begin,
+        const types::global_dof_index end)
+  {
+    std::vector<types::global_dof_index> columns;
+    for (types::global_dof_index row=begin; row<end; ++row)
+      {
+        columns.clear ();
+        for (auto entry = sparsity_pattern.begin (old_numbers[row]);
+             entry != sparsity_pattern.end (old_numbers[row]);
+             ++entry)
+          columns.push_back (new_numbers[entry->column()]);
+        std::sort (columns.begin(), columns.end());
+
+        permuted_sparsity_pattern.add_entries (row,
+                                               columns.begin(),
+                                               columns.end(),
+                                               true);
+      }
+  },
+   1024);
+
+  permuted_sparsity_pattern.compress ();
 }
 
 
 
-void renumber_dofs (DoFHandler<2> &dof_handler)
+// The Cuthill-McKee ordering, computed from the couplings in the
+// compressed sparsity pattern. DoFRenumbering::compute_Cuthill_McKee and
+// SparsityTools::reorder_Cuthill_McKee both work on a
+// DynamicSparsityPattern, which is what we want to avoid building. The
+// search starts at a DoF with the fewest couplings, and numbers the
+// unnumbered neighbors of each DoF in the order of their number of
+// couplings, which costs O(nnz log(row length)).
+void compute_Cuthill_McKee (const SparsityPattern &sparsity_pattern,
+                            std::vector<types::global_dof_index> &new_numbers)
 {
-  DoFRenumbering::Cuthill_McKee (dof_handler);
+  const types::global_dof_index n = sparsity_pattern.n_rows();
+  AssertDimension (new_numbers.size(), n);
+
+  const types::global_dof_index unnumbered = numbers::invalid_dof_index;
+  std::fill (new_numbers.begin(), new_numbers.end(), unnumbered);
 
-  DynamicSparsityPattern dynamic_sparsity_pattern(dof_handler.n_dofs(),
-                                                  dof_handler.n_dofs());
-  DoFTools::make_sparsity_pattern (dof_handler, dynamic_sparsity_pattern);
+  const auto fewer_couplings = [&] (const types::global_dof_index i,
+                                    const types::global_dof_index j)
+  {
+    return sparsity_pattern.row_length (i) < sparsity_pattern.row_length (j);
+  };
 
-  SparsityPattern sparsity_pattern;
-  sparsity_pattern.copy_from (dynamic_sparsity_pattern);
+  // The old numbers, in the new order.
+  std::vector<types::global_dof_index> order;
+  order.reserve (n);
 
-  std::ofstream out ("sparsity_pattern2.svg");
-  sparsity_pattern.print_svg (out);
+  types::global_dof_index first_unnumbered = 0;
+  while (order.size() < n)
+    {
+      // Every connected component starts at its DoF with the fewest
+      // couplings.
+      while (new_numbers[first_unnumbered] != unnumbered)
+        ++first_unnumbered;
+      types::global_dof_index start = first_unnumbered;
+      for (types::global_dof_index i=first_unnumbered+1; i<n; ++i)
+        if (new_numbers[i] == unnumbered && fewer_couplings (i, start))
+          start = i;
+
+      new_numbers[start] = order.size();
+      order.push_back (start);
+
+      for (std::size_t k=order.size()-1; k<order.size(); ++k)
+        {
+          const std::size_t first_new = order.size();
+          for (auto entry = sparsity_pattern.begin (order[k]);
+               entry != sparsity_pattern.end (order[k]);
+               ++entry)
+            if (new_numbers[entry->column()] == unnumbered)
+              {
+                new_numbers[entry->column()] = order.size();
+                order.push_back (entry->column());
+              }
+
+          std::stable_sort (order.begin() + first_new, order.end(),
+                            fewer_couplings);
+          for (std::size_t i=first_new; i<order.size(); ++i)
+            new_numbers[order[i]] = i;
+        }
+    }
 }
 
 
 
+void renumber_dofs (DoFHandler<2> &dof_handler,
+                    const SparsityPattern &sparsity_pattern,
+                    SparsityPattern &renumbered_sparsity_pattern)
+{
+  std::vector<types::global_dof_index> new_numbers (dof_handler.n_dofs());
+  compute_Cuthill_McKee (sparsity_pattern, new_numbers);
+  dof_handler.renumber_dofs (new_numbers);
+
+  permute_sparsity_pattern (sparsity_pattern,
+                            new_numbers,
+                            renumbered_sparsity_pattern);
+
+  write_sparsity_pattern (renumbered_sparsity_pattern, "sparsity_pattern2");
+}
+
+
+
+
+
+// Writes the statistics of a sparsity pattern (bandwidth, row lengths,
+// locality of the nonzeros, ...) as JSON, so that the effect of a
+// renumbering can be compared by a script rather than only by eye.
+void write_sparsity_statistics (const SparsityPattern &sparsity_pattern,
+                                const std::string &filename)
+{
+  const SparsityStatistics statistics (sparsity_pattern);
+
+  std::ofstream out (filename);
+  statistics.write_json (out);
+
+  std::cout << filename << ": " << statistics.n_nonzero_elements()
+            << " nonzeros, bandwidth " << statistics.bandwidth()
+            << ", " << statistics.average_row_length()
+            << " entries per row on average" << std::endl;
+}
+
 
 
-int main ()
+// Cuthill-McKee minimizes the bandwidth of the matrix, but says nothing
+// about the order in which a loop over the cells touches the DoFs. Numbering
+// the DoFs cell by cell along a space filling curve, and looping over the
+// cells in the same order, makes assembly and matrix-vector products walk
+// through memory almost sequentially. Here we time both for the three
+// orderings; for Cuthill-McKee the cells are visited in the order of the
+// triangulation.
+void compare_orderings (DoFHandler<2> &dof_handler)
 {
+  typedef std::vector<DoFHandler<2>::active_cell_iterator> CellOrder;
+
+  const std::vector<std::pair<std::string,
+        std::function<CellOrder (DoFHandler<2> &)> > > orderings
+  =
+  {
+    {
+      "Cuthill_McKee", [] (DoFHandler<2> &dh)
+      {
+        DoFRenumbering::Cuthill_McKee (dh);
+        CellOrder cells;
+        for (const auto &cell : dh.active_cell_iterators())
+          cells.push_back (cell);
+        return cells;
+      }
+    },
+    {
+      "Hilbert", [] (DoFHandler<2> &dh)
+      {
+        return renumber_along_curve (dh, SpaceFillingCurve::hilbert);
+      }
+    },
+    {
+      "Morton", [] (DoFHandler<2> &dh)
+      {
+        return renumber_along_curve (dh, SpaceFillingCurve::morton);
+      }
+    }
+  };
+
+  const QGauss<2> quadrature_formula (2);
+  FEValues<2> fe_values (dof_handler.get_fe(), quadrature_formula,
+                         update_gradients | update_JxW_values);
+
+  const unsigned int dofs_per_cell = dof_handler.get_fe().dofs_per_cell;
+  FullMatrix<double> cell_matrix (dofs_per_cell, dofs_per_cell);
+  std::vector<types::global_dof_index> local_dof_indices (dofs_per_cell);
+
+  for (const auto &ordering : orderings)
+    {
+      dof_handler.distribute_dofs (dof_handler.get_fe());
+      const CellOrder cells = ordering.second (dof_handler);
+
+      SparsityPattern sparsity_pattern;
+      build_sparsity_pattern (dof_handler, sparsity_pattern);
+      SparseMatrix<double> matrix (sparsity_pattern);
+
+      Timer timer;
+      for (const auto &cell : cells)
+        {
+          fe_values.reinit (cell);
+          cell_matrix = 0;
+          for (unsigned int q=0; q<quadrature_formula.size(); ++q)
+            for (unsigned int i=0; i<dofs_per_cell; ++i)
+              for (unsigned int j=0; j<dofs_per_cell; ++j)
+                cell_matrix(i,j) += (fe_values.shape_grad (i, q) *
+                                     fe_values.shape_grad (j, q) *
+                                     fe_values.JxW (q));
+          cell->get_dof_indices (local_dof_indices);
+          matrix.add (local_dof_indices, cell_matrix);
+        }
+      const double assembly_time = timer.wall_time();
+
+      Vector<double> src (dof_handler.n_dofs()), dst (dof_handler.n_dofs());
+      src = 1.;
+      const unsigned int n_repetitions = 20;
+      timer.restart ();
+      for (unsigned int i=0; i<n_repetitions; ++i)
+        matrix.vmult (dst, src);
+      const double spmv_time = timer.wall_time() / n_repetitions;
+
+      std::cout << ordering.first << ": assembly " << assembly_time
+                << "s, SpMV " << spmv_time << "s, bandwidth "
+                << sparsity_pattern.bandwidth() << std::endl;
+    }
+}
+
+
+
+// The resident memory of the process in kB, after resetting its high water
+// mark to it (Linux only), so that VmHWM afterwards is the peak of what
+// runs in between.
+unsigned long int reset_peak_memory ()
+{
+  std::ofstream ("/proc/self/clear_refs") << "5";
+
+  Utilities::System::MemoryStats stats;
+  Utilities::System::get_memory_stats (stats);
+  return stats.VmRSS;
+}
+
+
+
+unsigned long int peak_memory_since (const unsigned long int start)
+{
+  Utilities::System::MemoryStats stats;
+  Utilities::System::get_memory_stats (stats);
+  return stats.VmHWM - start;
+}
+
+
+
+// Time and peak memory of the sparsity pattern with hanging node
+// constraints, built once through a DynamicSparsityPattern as in step-6 and
+// once directly, and a check that both give the same pattern.
+void compare_sparsity_builders (const DoFHandler<2> &dof_handler)
+{
+  AffineConstraints<double> constraints;
+  DoFTools::make_hanging_node_constraints (dof_handler, constraints);
+  constraints.close ();
+
+  SparsityPattern dsp_sparsity_pattern, direct_sparsity_pattern;
+
+  unsigned long int start = reset_peak_memory ();
+  Timer timer;
+  {
+    DynamicSparsityPattern dsp (dof_handler.n_dofs());
+    DoFTools::make_sparsity_pattern (dof_handler, dsp, constraints, true);
+    dsp_sparsity_pattern.copy_from (dsp);
+  }
+  const double dsp_time = timer.wall_time();
+  const unsigned long int dsp_memory = peak_memory_since (start);
+
+  start = reset_peak_memory ();
+  timer.restart ();
+  build_sparsity_pattern (dof_handler, direct_sparsity_pattern, constraints);
+  const double direct_time = timer.wall_time();
+  const unsigned long int direct_memory = peak_memory_since (start);
+
+  AssertThrow (direct_sparsity_pattern == dsp_sparsity_pattern,
+               ExcMessage ("The direct builder and make_sparsity_pattern "
+                           "give different patterns."));
+
+  std::cout << "DynamicSparsityPattern + copy_from: " << dsp_time
+            << "s, peak " << dsp_memory << " kB" << std::endl
+            << "build_sparsity_pattern: " << direct_time
+            << "s, peak " << direct_memory << " kB" << std::endl;
+}
+
+
+
+int main (int argc, char **argv)
+{
+  // Pass --no-cache to ignore the mesh cache, or --refresh-cache to rebuild
+  // its entries.
+  const TriangulationCache::Mode cache_mode
+    = TriangulationCache::mode_from_command_line (argc, argv);
+
   Triangulation<2> triangulation;
-  make_grid (triangulation);
+  make_grid (triangulation, cache_mode);
 
   DoFHandler<2> dof_handler (triangulation);
 
-  distribute_dofs (dof_handler);
-  renumber_dofs (dof_handler);
+  SparsityPattern sparsity_pattern, renumbered_sparsity_pattern;
+  distribute_dofs (dof_handler, sparsity_pattern);
+  renumber_dofs (dof_handler, sparsity_pattern, renumbered_sparsity_pattern);
+
+  write_sparsity_statistics (sparsity_pattern, "sparsity_statistics1.json");
+  write_sparsity_statistics (renumbered_sparsity_pattern,
+                             "sparsity_statistics2.json");
+
+  compare_sparsity_builders (dof_handler);
+  compare_orderings (dof_handler);
 }
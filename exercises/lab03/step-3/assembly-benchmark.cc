@@ -0,0 +1,261 @@
+// Cost of the cell loop of the step-3 assembly: for dim = 2, 3 and FE_Q
+// degrees 1 to 4, time the computation of all cell matrices and right hand
+// sides once with FEValues, as in step-3, and once with the LaplaceKernel of
+// assembly_kernels.h, whose sizes are known at compile time, and once with
+// the BatchedLaplaceKernel of vectorized_assembly.h, which works on as many
+// cells at once as there are SIMD lanes. With deal.II 9.2 or later, the
+// batched kernel is also run with 1, 2, 4 and 8 lanes, as far as the
+// vectorization width deal.II was configured with allows, and reported in
+// cells per second. The scatter into the global matrix is the same for all
+// and is left out. The mesh is a randomly distorted hyper_cube, so that no
+// cell is affine.
+
+
+#include <deal.II/base/function.h>
+#include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/table_handler.h>
+#include <deal.II/base/timer.h>
+#include <deal.II/base/vectorization.h>
+
+#include <deal.II/dofs/dof_accessor.h>
+#include <deal.II/dofs/dof_handler.h>
+
+#include <deal.II/fe/fe_q.h>
+#include <deal.II/fe/fe_values.h>
+
+#include <deal.II/grid/grid_generator.h>
+#include <deal.II/grid/grid_tools.h>
+#include <deal.II/grid/tria.h>
+
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/vector.h>
+
+#include <assembly_kernels.h>
+#include <vectorized_assembly.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace dealii;
+
+
+/**
+ * The sum of the absolute values of all entries, to check that both loops
+ * compute the same matrices and to keep the compiler from dropping them.
+ */
+double
+checksum(const FullMatrix<double> &cell_matrix, const Vector<double> &cell_rhs)
+{
+  double sum = cell_rhs.l1_norm();
+  for (unsigned int i = 0; i < cell_matrix.m(); ++i)
+    for (unsigned int j = 0; j < cell_matrix.n(); ++j)
+      sum += std::abs(cell_matrix(i, j));
+  return sum;
+}
+
+
+
+template <int dim>
+double
+generic_cell_loop(const DoFHandler<dim> &dof_handler, double &sum)
+{
+  const FiniteElement<dim> &fe = dof_handler.get_fe();
+  const QGauss<dim>         quadrature_formula(fe.degree + 1);
+  FEValues<dim>             fe_values(fe,
+                          quadrature_formula,
+                          update_values | update_gradients |
+                            update_JxW_values);
+
+  const unsigned int dofs_per_cell = fe.dofs_per_cell;
+  const unsigned int n_q_points    = quadrature_formula.size();
+
+  FullMatrix<double> cell_matrix(dofs_per_cell, dofs_per_cell);
+  Vector<double>     cell_rhs(dofs_per_cell);
+
+  sum = 0;
+  Timer timer;
+  for (const auto &cell : dof_handler.active_cell_iterators())
+    {
+      fe_values.reinit(cell);
+
+      cell_matrix = 0;
+      cell_rhs    = 0;
+      for (unsigned int q = 0; q < n_q_points; ++q)
+        {
+          for (unsigned int i = 0; i < dofs_per_cell; ++i)
+            for (unsigned int j = 0; j < dofs_per_cell; ++j)
+              cell_matrix(i, j) += fe_values.shape_grad(i, q) *
+                                   fe_values.shape_grad(j, q) *
+                                   fe_values.JxW(q);
+
+          for (unsigned int i = 0; i < dofs_per_cell; ++i)
+            cell_rhs(i) += fe_values.shape_value(i, q) * fe_values.JxW(q);
+        }
+
+      sum += checksum(cell_matrix, cell_rhs);
+    }
+  return timer.wall_time();
+}
+
+
+
+template <int dim, int degree>
+double
+kernel_cell_loop(const DoFHandler<dim> &dof_handler, double &sum)
+{
+  typedef LaplaceKernel<dim, degree, degree + 1> Kernel;
+  const std::unique_ptr<const Kernel> kernel(new Kernel());
+
+  FullMatrix<double> cell_matrix(Kernel::dofs_per_cell, Kernel::dofs_per_cell);
+  Vector<double>     cell_rhs(Kernel::dofs_per_cell);
+  Point<dim>         vertices[Kernel::n_vertices];
+
+  sum = 0;
+  Timer timer;
+  for (const auto &cell : dof_handler.active_cell_iterators())
+    {
+      for (unsigned int v = 0; v < Kernel::n_vertices; ++v)
+        vertices[v] = cell->vertex(v);
+      kernel->compute(vertices, UnitCoefficient(), 1., cell_matrix, cell_rhs);
+
+      sum += checksum(cell_matrix, cell_rhs);
+    }
+  return timer.wall_time();
+}
+
+
+
+template <int dim, int degree, typename Number>
+double
+batched_cell_loop(const DoFHandler<dim> &dof_handler, double &sum)
+{
+  typedef BatchedLaplaceKernel<dim, degree, degree + 1, Number> Kernel;
+  const std::unique_ptr<const Kernel> kernel(new Kernel());
+
+  typename Kernel::ScratchData scratch;
+  typename Kernel::CopyData    copy_data;
+
+  std::vector<typename DoFHandler<dim>::active_cell_iterator> cells;
+  for (const auto &cell : dof_handler.active_cell_iterators())
+    cells.push_back(cell);
+
+  const Functions::ConstantFunction<dim> rhs_function(1.);
+
+  sum = 0;
+  Timer timer;
+  for (unsigned int first = 0; first < cells.size(); first += Kernel::n_lanes)
+    {
+      const unsigned int n_cells =
+        std::min<unsigned int>(Kernel::n_lanes, cells.size() - first);
+      kernel->compute(
+        &cells[first], n_cells, rhs_function, scratch, copy_data);
+
+      for (unsigned int c = 0; c < n_cells; ++c)
+        sum += checksum(copy_data.cell_matrices[c], copy_data.cell_rhs[c]);
+    }
+  return timer.wall_time();
+}
+
+
+
+#if DEAL_II_VERSION_GTE(9, 2, 0)
+/**
+ * Add the throughput of the batched kernel with @p width lanes to the
+ * table.
+ */
+template <int dim, int degree, int width>
+void
+add_cells_per_second(TableHandler &table, const DoFHandler<dim> &dof_handler)
+{
+  double       sum;
+  const double time =
+    batched_cell_loop<dim, degree, VectorizedArray<double, width>>(dof_handler,
+                                                                    sum);
+  table.add_value("cells/s, " + std::to_string(width) + " lanes",
+                  dof_handler.get_triangulation().n_active_cells() / time);
+}
+#endif
+
+
+
+template <int dim, int degree>
+void
+benchmark(TableHandler &table, const unsigned int n_refinements)
+{
+  Triangulation<dim> triangulation;
+  GridGenerator::hyper_cube(triangulation, -1, 1);
+  triangulation.refine_global(n_refinements);
+  GridTools::distort_random(0.2, triangulation);
+
+  const FE_Q<dim> fe(degree);
+  DoFHandler<dim> dof_handler(triangulation);
+  dof_handler.distribute_dofs(fe);
+
+  double       generic_sum, kernel_sum, batched_sum;
+  const double generic_time = generic_cell_loop(dof_handler, generic_sum);
+  const double kernel_time =
+    kernel_cell_loop<dim, degree>(dof_handler, kernel_sum);
+  const double batched_time =
+    batched_cell_loop<dim, degree, VectorizedArray<double>>(dof_handler,
+                                                            batched_sum);
+
+  table.add_value("dim", dim);
+  table.add_value("degree", degree);
+  table.add_value("n_cells", triangulation.n_active_cells());
+  table.add_value("generic", generic_time);
+  table.add_value("kernel", kernel_time);
+  table.add_value("batched", batched_time);
+  table.add_value("speedup", generic_time / batched_time);
+  table.add_value("difference",
+                  std::max(std::abs(generic_sum - kernel_sum),
+                           std::abs(generic_sum - batched_sum)) /
+                    generic_sum);
+
+#if DEAL_II_VERSION_GTE(9, 2, 0)
+  add_cells_per_second<dim, degree, 1>(table, dof_handler);
+#  if DEAL_II_VECTORIZATION_WIDTH_IN_BITS >= 128
+  add_cells_per_second<dim, degree, 2>(table, dof_handler);
+#  endif
+#  if DEAL_II_VECTORIZATION_WIDTH_IN_BITS >= 256
+  add_cells_per_second<dim, degree, 4>(table, dof_handler);
+#  endif
+#  if DEAL_II_VECTORIZATION_WIDTH_IN_BITS >= 512
+  add_cells_per_second<dim, degree, 8>(table, dof_handler);
+#  endif
+#endif
+
+  std::cout << dim << "d, Q" << degree << " done" << std::endl;
+}
+
+
+
+int
+main()
+{
+  TableHandler table;
+
+  benchmark<2, 1>(table, 9);
+  benchmark<2, 2>(table, 8);
+  benchmark<2, 3>(table, 7);
+  benchmark<2, 4>(table, 7);
+
+  benchmark<3, 1>(table, 5);
+  benchmark<3, 2>(table, 4);
+  benchmark<3, 3>(table, 3);
+  benchmark<3, 4>(table, 3);
+
+  table.set_scientific("generic", true);
+  table.set_scientific("kernel", true);
+  table.set_scientific("batched", true);
+  table.set_scientific("difference", true);
+
+  table.write_text(std::cout, TableHandler::org_mode_table);
+
+  std::ofstream out("assembly-benchmark.txt");
+  table.write_text(out);
+}
@@ -32,6 +32,7 @@
 
 #include <deal.II/fe/fe_q.h>
 #include <deal.II/fe/fe_values.h>
+#include <deal.II/fe/mapping_q1.h>
 
 #include <deal.II/grid/grid_generator.h>
 #include <deal.II/grid/grid_refinement.h>
@@ -40,23 +41,28 @@
 #include <deal.II/grid/tria_iterator.h>
 
 #include <deal.II/lac/affine_constraints.h>
-#include <deal.II/lac/dynamic_sparsity_pattern.h>
 #include <deal.II/lac/full_matrix.h>
 #include <deal.II/lac/precondition.h>
 #include <deal.II/lac/solver_cg.h>
 #include <deal.II/lac/sparse_matrix.h>
 #include <deal.II/lac/vector.h>
 
-#include <deal.II/meshworker/copy_data.h>
-#include <deal.II/meshworker/scratch_data.h>
-
-#include <deal.II/numerics/data_out.h>
 #include <deal.II/numerics/error_estimator.h>
 #include <deal.II/numerics/matrix_tools.h>
 #include <deal.II/numerics/vector_tools.h>
 
+#include <batched_scatter.h>
+#include <direct_sparsity_builder.h>
+#include <hdf5_xdmf_writer.h>
+#include <patch_cache.h>
+#include <space_filling_curve.h>
+#include <triangulation_cache.h>
+#include <vectorized_assembly.h>
+
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <memory>
 
 using namespace dealii;
 
@@ -65,7 +71,8 @@ template <int dim>
 class Step3
 {
 public:
-  Step3();
+  Step3(const TriangulationCache::Mode cache_mode =
+          TriangulationCache::Mode::use);
 
   void
   run(const unsigned int n_cycles           = 1,
@@ -94,10 +101,33 @@ private:
 
   mutable TimerOutput timer;
 
+  TriangulationCache triangulation_cache;
+
   Triangulation<dim> triangulation;
   FE_Q<dim>          fe;
   DoFHandler<dim>    dof_handler;
 
+#ifdef DEAL_II_WITH_HDF5
+  /**
+   * The solution and the error fields of all cycles, in one HDF5 file. The
+   * mesh is only written again after it has been refined.
+   */
+  mutable HDF5XDMFWriter<dim> hdf5_writer;
+#endif
+
+  /**
+   * The active cells in the order of the Hilbert curve through their
+   * centers, which is also the order of the DoFs. Loops over the cells go
+   * through this order.
+   */
+  std::vector<typename DoFHandler<dim>::active_cell_iterator> cell_order;
+
+  /**
+   * The output patches, rebuilt only when the mesh or the DoF numbering
+   * change.
+   */
+  mutable PatchCache<dim> patch_cache;
+
   AffineConstraints<double> constraints;
 
   SparsityPattern      sparsity_pattern;
@@ -122,10 +152,17 @@ private:
 };
 
 template <int dim>
-Step3<dim>::Step3()
+Step3<dim>::Step3(const TriangulationCache::Mode cache_mode)
   : timer(std::cout, TimerOutput::summary, TimerOutput::cpu_and_wall_times)
+  , triangulation_cache(cache_mode)
   , fe(1)
   , dof_handler(triangulation)
+#ifdef DEAL_II_WITH_HDF5
+  , hdf5_writer(dof_handler,
+                "solution",
+                HDF5XDMFWriter<dim>::Precision::float32)
+#endif
+  , patch_cache(dof_handler, StaticMappingQ1<dim>::mapping, fe.degree)
   , exact_solution("exp(x)*exp(y)")
   , rhs_function("-2*exp(x)*exp(y)")
   , error_table({"u"}, {{VectorTools::H1_norm, VectorTools::L2_norm}})
@@ -139,7 +176,10 @@ Step3<dim>::make_grid(const unsigned int ref_level)
   TimerOutput::Scope timer_section(timer, "Make grid");
   triangulation.clear();
   GridGenerator::hyper_cube(triangulation, -1, 1);
-  triangulation.refine_global(ref_level);
+  triangulation_cache.refine(triangulation,
+                             "refine_global(" + std::to_string(ref_level) +
+                               ")",
+                             [&]() { triangulation.refine_global(ref_level); });
 
   std::cout << "Number of active cells: " << triangulation.n_active_cells()
             << std::endl;
@@ -185,6 +225,8 @@ Step3<dim>::setup_system()
 {
   TimerOutput::Scope timer_section(timer, "Setup dofs");
   dof_handler.distribute_dofs(fe);
+  cell_order = renumber_along_curve(dof_handler, SpaceFillingCurve::hilbert);
+  patch_cache.invalidate();
 
   constraints.clear();
   DoFTools::make_hanging_node_constraints(dof_handler, constraints);
@@ -195,9 +237,7 @@ Step3<dim>::setup_system()
                                            constraints);
   constraints.close();
 
-  DynamicSparsityPattern dsp(dof_handler.n_dofs());
-  DoFTools::make_sparsity_pattern(dof_handler, dsp, constraints);
-  sparsity_pattern.copy_from(dsp);
+  build_sparsity_pattern(dof_handler, sparsity_pattern, constraints);
 
   system_matrix.reinit(sparsity_pattern);
 
@@ -211,65 +251,50 @@ void
 Step3<dim>::assemble_system()
 {
   TimerOutput::Scope timer_section(timer, "Assemble system");
-  QGauss<dim>        quadrature_formula(2);
-
-  MeshWorker::ScratchData<dim> scratch(fe,
-                                       quadrature_formula,
-                                       update_quadrature_points |
-                                         update_values | update_gradients |
-                                         update_JxW_values);
-
-  const unsigned int dofs_per_cell = fe.dofs_per_cell;
-  const unsigned int n_q_points    = quadrature_formula.size();
-
-  MeshWorker::CopyData<1, 1, 1> copy_data(dofs_per_cell);
-
-  auto worker = [&](const decltype(dof_handler.begin_active()) &cell,
-                    MeshWorker::ScratchData<dim> &              scratch,
-                    MeshWorker::CopyData<1, 1, 1> &             copy_data) {
-    auto &fe_values = scratch.reinit(cell);
-
-    copy_data.matrices[0] = 0;
-    copy_data.vectors[0]  = 0;
-
-    const auto &q_points = scratch.get_quadrature_points();
-
-    for (unsigned int q_index = 0; q_index < n_q_points; ++q_index)
-      {
-        for (unsigned int i = 0; i < dofs_per_cell; ++i)
-          for (unsigned int j = 0; j < dofs_per_cell; ++j)
-            copy_data.matrices[0](i, j) +=
-              (fe_values.shape_grad(i, q_index) *
-               fe_values.shape_grad(j, q_index) * fe_values.JxW(q_index));
-
-        for (unsigned int i = 0; i < dofs_per_cell; ++i)
-          copy_data.vectors[0](i) +=
-            (fe_values.shape_value(i, q_index) *
-             rhs_function.value(q_points[q_index]) * fe_values.JxW(q_index));
-      }
-    cell->get_dof_indices(copy_data.local_dof_indices[0]);
+
+  // The kernel computes the cell matrices of FE_Q(1) with QGauss(2) for as
+  // many consecutive cells along the Hilbert curve as there are SIMD lanes
+  // at once.
+  AssertDimension(fe.degree, 1);
+  using Kernel = BatchedLaplaceKernel<dim, 1, 2>;
+  const std::unique_ptr<const Kernel> kernel(new Kernel());
+
+  const std::vector<unsigned int> batches =
+    make_cell_batches(cell_order.size(), Kernel::n_lanes);
+
+  typename Kernel::ScratchData scratch;
+  typename Kernel::CopyData    copy_data;
+
+  auto worker = [&](const std::vector<unsigned int>::const_iterator &batch,
+                    typename Kernel::ScratchData &scratch,
+                    typename Kernel::CopyData &   copy_data) {
+    const unsigned int n_cells =
+      std::min<unsigned int>(Kernel::n_lanes, cell_order.size() - *batch);
+    kernel->compute(
+      &cell_order[*batch], n_cells, rhs_function, scratch, copy_data);
   };
 
-  auto copier = [&](const MeshWorker::CopyData<1, 1, 1> &copy_data) {
-    constraints.distribute_local_to_global(copy_data.matrices[0],
-                                           copy_data.vectors[0],
-                                           copy_data.local_dof_indices[0],
-                                           system_matrix,
-                                           system_rhs);
+  // The copier runs on one thread at a time, so all cells can share the
+  // scratch arrays of one scatter object.
+  BatchedScatter scatter;
+  auto           copier = [&](const typename Kernel::CopyData &copy_data) {
+    for (unsigned int c = 0; c < copy_data.n_cells; ++c)
+      scatter.add(copy_data.cell_matrices[c],
+                  copy_data.cell_rhs[c],
+                  copy_data.local_dof_indices[c],
+                  constraints,
+                  system_matrix,
+                  system_rhs);
   };
 
-  //  for (auto cell : dof_handler.active_cell_iterators())
+  //  for (auto batch = batches.cbegin(); batch != batches.cend(); ++batch)
   //    {
-  //      worker(cell, scratch, copy_data);
+  //      worker(batch, scratch, copy_data);
   //      copier(copy_data);
   //    }
 
-  WorkStream::run(dof_handler.begin_active(),
-                  dof_handler.end(),
-                  worker,
-                  copier,
-                  scratch,
-                  copy_data);
+  WorkStream::run(
+    batches.cbegin(), batches.cend(), worker, copier, scratch, copy_data);
 }
 
 
@@ -321,16 +346,23 @@ void
 Step3<dim>::output_results(const unsigned int cycle) const
 {
   TimerOutput::Scope timer_section(timer, "Output results");
-  DataOut<dim>       data_out;
-  data_out.attach_dof_handler(dof_handler);
-  data_out.add_data_vector(solution, "solution");
-  data_out.add_data_vector(L2_error_per_cell, "L2_error");
-  data_out.add_data_vector(H1_error_per_cell, "H1_error");
-  data_out.add_data_vector(error_estimator, "Error_estimator");
-  data_out.build_patches();
+#ifdef DEAL_II_WITH_HDF5
+  hdf5_writer.clear_data_vectors();
+  hdf5_writer.add_data_vector(solution, "solution");
+  hdf5_writer.add_data_vector(L2_error_per_cell, "L2_error");
+  hdf5_writer.add_data_vector(H1_error_per_cell, "H1_error");
+  hdf5_writer.add_data_vector(error_estimator, "Error_estimator");
+  hdf5_writer.write(cycle);
+#else
+  patch_cache.clear_data_vectors();
+  patch_cache.add_data_vector(solution, "solution");
+  patch_cache.add_data_vector(L2_error_per_cell, "L2_error");
+  patch_cache.add_data_vector(H1_error_per_cell, "H1_error");
+  patch_cache.add_data_vector(error_estimator, "Error_estimator");
 
   std::ofstream output("solution_" + std::to_string(cycle) + ".vtu");
-  data_out.write_vtu(output);
+  patch_cache.write_vtu(output);
+#endif
 }
 
 
@@ -375,7 +407,10 @@ main(int argc, char **argv)
 
   deallog.depth_console(2);
 
-  Step3<2> laplace_problem;
+  // Pass --no-cache to ignore the mesh cache, or --refresh-cache to rebuild
+  // its entries.
+  Step3<2> laplace_problem(
+    TriangulationCache::mode_from_command_line(argc, argv));
   laplace_problem.run(8);
 
   return 0;
@@ -38,7 +38,6 @@
 #include <deal.II/fe/fe_q.h>
 #include <deal.II/fe/fe_values.h>
 
-#include <deal.II/grid/filtered_iterator.h>
 #include <deal.II/grid/grid_generator.h>
 #include <deal.II/grid/grid_refinement.h>
 #include <deal.II/grid/tria.h>
@@ -54,16 +53,18 @@
 #include <deal.II/lac/sparse_matrix.h>
 #include <deal.II/lac/vector.h>
 
-#include <deal.II/meshworker/copy_data.h>
-#include <deal.II/meshworker/scratch_data.h>
-
 #include <deal.II/numerics/data_out.h>
 #include <deal.II/numerics/error_estimator.h>
 #include <deal.II/numerics/matrix_tools.h>
 #include <deal.II/numerics/vector_tools.h>
 
+#include <vectorized_assembly.h>
+
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 using namespace dealii;
 
@@ -250,70 +251,49 @@ void
 Step3<dim>::assemble_system()
 {
   TimerOutput::Scope timer_section(timer, "Assemble system");
-  QGauss<dim>        quadrature_formula(2);
-
-  MeshWorker::ScratchData<dim> scratch(fe,
-                                       quadrature_formula,
-                                       update_quadrature_points |
-                                         update_values | update_gradients |
-                                         update_JxW_values);
-
-  const unsigned int dofs_per_cell = fe.dofs_per_cell;
-  const unsigned int n_q_points    = quadrature_formula.size();
-
-  MeshWorker::CopyData<1, 1, 1> copy_data(dofs_per_cell);
-
-  auto worker = [&](const decltype(dof_handler.begin_active()) &cell,
-                    MeshWorker::ScratchData<dim> &              scratch,
-                    MeshWorker::CopyData<1, 1, 1> &             copy_data) {
-    auto &fe_values = scratch.reinit(cell);
-
-    copy_data.matrices[0] = 0;
-    copy_data.vectors[0]  = 0;
-
-    const auto &q_points = scratch.get_quadrature_points();
-
-    for (unsigned int q_index = 0; q_index < n_q_points; ++q_index)
-      {
-        for (unsigned int i = 0; i < dofs_per_cell; ++i)
-          for (unsigned int j = 0; j < dofs_per_cell; ++j)
-            copy_data.matrices[0](i, j) +=
-              (fe_values.shape_grad(i, q_index) *
-               fe_values.shape_grad(j, q_index) * fe_values.JxW(q_index));
-
-        for (unsigned int i = 0; i < dofs_per_cell; ++i)
-          copy_data.vectors[0](i) +=
-            (fe_values.shape_value(i, q_index) *
-             rhs_function.value(q_points[q_index]) * fe_values.JxW(q_index));
-      }
-    cell->get_dof_indices(copy_data.local_dof_indices[0]);
-  };
 
-  auto copier = [&](const MeshWorker::CopyData<1, 1, 1> &copy_data) {
-    constraints.distribute_local_to_global(copy_data.matrices[0],
-                                           copy_data.vectors[0],
-                                           copy_data.local_dof_indices[0],
-                                           system_matrix,
-                                           system_rhs);
+  // The kernel computes the cell matrices of FE_Q(1) with QGauss(2) for as
+  // many locally owned cells as there are SIMD lanes at once.
+  AssertDimension(fe.degree, 1);
+  using Kernel = BatchedLaplaceKernel<dim, 1, 2>;
+  const std::unique_ptr<const Kernel> kernel(new Kernel());
+
+  std::vector<typename DoFHandler<dim>::active_cell_iterator> cells;
+  for (const auto &cell : dof_handler.active_cell_iterators())
+    if (cell->is_locally_owned())
+      cells.push_back(cell);
+
+  const std::vector<unsigned int> batches =
+    make_cell_batches(cells.size(), Kernel::n_lanes);
+
+  typename Kernel::ScratchData scratch;
+  typename Kernel::CopyData    copy_data;
+
+  auto worker = [&](const std::vector<unsigned int>::const_iterator &batch,
+                    typename Kernel::ScratchData &scratch,
+                    typename Kernel::CopyData &   copy_data) {
+    const unsigned int n_cells =
+      std::min<unsigned int>(Kernel::n_lanes, cells.size() - *batch);
+    kernel->compute(&cells[*batch], n_cells, rhs_function, scratch, copy_data);
   };
 
-  //  for (auto cell : dof_handler.active_cell_iterators())
-  //    if (cell->is_locally_owned())
-  //      {
-  //        worker(cell, scratch, copy_data);
-  //        copier(copy_data);
-  //      }
+  auto copier = [&](const typename Kernel::CopyData &copy_data) {
+    for (unsigned int c = 0; c < copy_data.n_cells; ++c)
+      constraints.distribute_local_to_global(copy_data.cell_matrices[c],
+                                             copy_data.cell_rhs[c],
+                                             copy_data.local_dof_indices[c],
+                                             system_matrix,
+                                             system_rhs);
+  };
 
-  using CellFilter =
-    FilteredIterator<typename DoFHandler<dim>::active_cell_iterator>;
+  //  for (auto batch = batches.cbegin(); batch != batches.cend(); ++batch)
+  //    {
+  //      worker(batch, scratch, copy_data);
+  //      copier(copy_data);
+  //    }
 
   WorkStream::run(
-    CellFilter(IteratorFilters::LocallyOwnedCell(), dof_handler.begin_active()),
-    CellFilter(IteratorFilters::LocallyOwnedCell(), dof_handler.end()),
-    worker,
-    copier,
-    scratch,
-    copy_data);
+    batches.cbegin(), batches.cend(), worker, copier, scratch, copy_data);
 
   system_matrix.compress(VectorOperation::add);
   system_rhs.compress(VectorOperation::add);
@@ -35,7 +35,6 @@
 #include <deal.II/grid/tria_accessor.h>
 #include <deal.II/grid/tria_iterator.h>
 
-#include <deal.II/lac/dynamic_sparsity_pattern.h>
 #include <deal.II/lac/full_matrix.h>
 #include <deal.II/lac/precondition.h>
 #include <deal.II/lac/solver_cg.h>
@@ -46,6 +45,11 @@
 #include <deal.II/numerics/matrix_tools.h>
 #include <deal.II/numerics/vector_tools.h>
 
+#include <direct_sparsity_builder.h>
+#include <hdf5_xdmf_writer.h>
+#include <symmetric_sparse_matrix.h>
+#include <triangulation_cache.h>
+
 #include <fstream>
 #include <iostream>
 
@@ -56,7 +60,8 @@ template <int dim>
 class Step3
 {
 public:
-  Step3();
+  Step3(const TriangulationCache::Mode cache_mode =
+          TriangulationCache::Mode::use);
 
   void
   run(const unsigned int n_cycles           = 1,
@@ -79,12 +84,21 @@ private:
   void
   output_results(const unsigned int cycle) const;
 
+  TriangulationCache triangulation_cache;
+
   Triangulation<dim> triangulation;
   FE_Q<dim>          fe;
   DoFHandler<dim>    dof_handler;
 
-  SparsityPattern      sparsity_pattern;
-  SparseMatrix<double> system_matrix;
+#ifdef DEAL_II_WITH_HDF5
+  /**
+   * The solution and the error fields of all cycles, in one HDF5 file. The
+   * mesh is only written again after it has been refined.
+   */
+  mutable HDF5XDMFWriter<dim> hdf5_writer;
+#endif
+
+  SymmetricSparseMatrix<double> system_matrix;
 
   Vector<double> solution;
   Vector<double> system_rhs;
@@ -103,9 +117,15 @@ private:
 };
 
 template <int dim>
-Step3<dim>::Step3()
-  : fe(1)
+Step3<dim>::Step3(const TriangulationCache::Mode cache_mode)
+  : triangulation_cache(cache_mode)
+  , fe(1)
   , dof_handler(triangulation)
+#ifdef DEAL_II_WITH_HDF5
+  , hdf5_writer(dof_handler,
+                "solution",
+                HDF5XDMFWriter<dim>::Precision::float32)
+#endif
   , exact_solution("exp(x)*exp(y)")
   , rhs_function("-2*exp(x)*exp(y)")
   , error_table({"u"}, {{VectorTools::H1_norm, VectorTools::L2_norm}})
@@ -118,7 +138,10 @@ Step3<dim>::make_grid(const unsigned int ref_level)
 {
   triangulation.clear();
   GridGenerator::hyper_cube(triangulation, -1, 1);
-  triangulation.refine_global(ref_level);
+  triangulation_cache.refine(triangulation,
+                             "refine_global(" + std::to_string(ref_level) +
+                               ")",
+                             [&]() { triangulation.refine_global(ref_level); });
 
   std::cout << "Number of active cells: " << triangulation.n_active_cells()
             << std::endl;
@@ -139,11 +162,20 @@ void
 Step3<dim>::setup_system()
 {
   dof_handler.distribute_dofs(fe);
-  DynamicSparsityPattern dsp(dof_handler.n_dofs());
-  DoFTools::make_sparsity_pattern(dof_handler, dsp);
-  sparsity_pattern.copy_from(dsp);
-
-  system_matrix.reinit(sparsity_pattern);
+  // The matrix keeps its own copy of the upper triangle, so the full
+  // pattern is only needed to set it up.
+  {
+    SparsityPattern sparsity_pattern;
+    build_sparsity_pattern(dof_handler, sparsity_pattern);
+
+    system_matrix.reinit(sparsity_pattern);
+    std::cout << "Matrix memory: " << system_matrix.memory_consumption()
+              << " bytes for " << system_matrix.n_nonzero_elements()
+              << " stored entries, SparseMatrix<double>: "
+              << sparsity_pattern.memory_consumption() +
+                   sparsity_pattern.n_nonzero_elements() * sizeof(double)
+              << " bytes for pattern and values" << std::endl;
+  }
 
   solution.reinit(dof_handler.n_dofs());
   system_rhs.reinit(dof_handler.n_dofs());
@@ -209,10 +241,7 @@ Step3<dim>::assemble_system()
                                            0,
                                            exact_solution,
                                            boundary_values);
-  MatrixTools::apply_boundary_values(boundary_values,
-                                     system_matrix,
-                                     solution,
-                                     system_rhs);
+  system_matrix.apply_boundary_values(boundary_values, solution, system_rhs);
 }
 
 
@@ -223,7 +252,13 @@ Step3<dim>::solve()
   SolverControl solver_control(1000, 1e-12, false, false);
   SolverCG<>    solver(solver_control);
 
+  // The same solver as with SparseMatrix, so that iteration counts and
+  // timings compare like for like. SymmetricSparseMatrix also provides the
+  // kernels of PreconditionJacobi and PreconditionSSOR, e.g.
+  //   PreconditionSSOR<SymmetricSparseMatrix<double>> preconditioner;
+  //   preconditioner.initialize(system_matrix, 1.2);
   solver.solve(system_matrix, solution, system_rhs, PreconditionIdentity());
+  std::cout << "CG iterations: " << solver_control.last_step() << std::endl;
 }
 
 
@@ -260,6 +295,13 @@ template <int dim>
 void
 Step3<dim>::output_results(const unsigned int cycle) const
 {
+#ifdef DEAL_II_WITH_HDF5
+  hdf5_writer.clear_data_vectors();
+  hdf5_writer.add_data_vector(solution, "solution");
+  hdf5_writer.add_data_vector(L2_error_per_cell, "L2_error");
+  hdf5_writer.add_data_vector(H1_error_per_cell, "H1_error");
+  hdf5_writer.write(cycle);
+#else
   DataOut<dim> data_out;
   data_out.attach_dof_handler(dof_handler);
   data_out.add_data_vector(solution, "solution");
@@ -269,6 +311,7 @@ Step3<dim>::output_results(const unsigned int cycle) const
 
   std::ofstream output("solution_" + std::to_string(cycle) + ".vtu");
   data_out.write_vtu(output);
+#endif
 }
 
 
@@ -296,11 +339,14 @@ Step3<dim>::run(const unsigned int n_cycles,
 
 
 int
-main()
+main(int argc, char **argv)
 {
   deallog.depth_console(2);
 
-  Step3<2> laplace_problem;
+  // Pass --no-cache to ignore the mesh cache, or --refresh-cache to rebuild
+  // its entries.
+  Step3<2> laplace_problem(
+    TriangulationCache::mode_from_command_line(argc, argv));
   laplace_problem.run(4);
 
   return 0;
@@ -38,7 +38,6 @@
 #include <deal.II/grid/tria_iterator.h>
 
 #include <deal.II/lac/affine_constraints.h>
-#include <deal.II/lac/dynamic_sparsity_pattern.h>
 #include <deal.II/lac/full_matrix.h>
 #include <deal.II/lac/precondition.h>
 #include <deal.II/lac/solver_cg.h>
@@ -50,6 +49,11 @@
 #include <deal.II/numerics/matrix_tools.h>
 #include <deal.II/numerics/vector_tools.h>
 
+#include <direct_sparsity_builder.h>
+#include <hdf5_xdmf_writer.h>
+#include <symmetric_sparse_matrix.h>
+#include <triangulation_cache.h>
+
 #include <fstream>
 #include <iostream>
 
@@ -60,7 +64,8 @@ template <int dim>
 class Step3
 {
 public:
-  Step3();
+  Step3(const TriangulationCache::Mode cache_mode =
+          TriangulationCache::Mode::use);
 
   void
   run(const unsigned int n_cycles           = 1,
@@ -89,14 +94,23 @@ private:
 
   mutable TimerOutput timer;
 
+  TriangulationCache triangulation_cache;
+
   Triangulation<dim> triangulation;
   FE_Q<dim>          fe;
   DoFHandler<dim>    dof_handler;
 
+#ifdef DEAL_II_WITH_HDF5
+  /**
+   * The solution and the error fields of all cycles, in one HDF5 file. The
+   * mesh is only written again after it has been refined.
+   */
+  mutable HDF5XDMFWriter<dim> hdf5_writer;
+#endif
+
   AffineConstraints<double> constraints;
 
-  SparsityPattern      sparsity_pattern;
-  SparseMatrix<double> system_matrix;
+  SymmetricSparseMatrix<double> system_matrix;
 
   Vector<double> solution;
   Vector<double> system_rhs;
@@ -117,10 +131,16 @@ private:
 };
 
 template <int dim>
-Step3<dim>::Step3()
+Step3<dim>::Step3(const TriangulationCache::Mode cache_mode)
   : timer(std::cout, TimerOutput::summary, TimerOutput::cpu_and_wall_times)
+  , triangulation_cache(cache_mode)
   , fe(1)
   , dof_handler(triangulation)
+#ifdef DEAL_II_WITH_HDF5
+  , hdf5_writer(dof_handler,
+                "solution",
+                HDF5XDMFWriter<dim>::Precision::float32)
+#endif
   , exact_solution("exp(x)*exp(y)")
   , rhs_function("-2*exp(x)*exp(y)")
   , error_table({"u"}, {{VectorTools::H1_norm, VectorTools::L2_norm}})
@@ -134,7 +154,10 @@ Step3<dim>::make_grid(const unsigned int ref_level)
   TimerOutput::Scope timer_section(timer, "Make grid");
   triangulation.clear();
   GridGenerator::hyper_cube(triangulation, -1, 1);
-  triangulation.refine_global(ref_level);
+  triangulation_cache.refine(triangulation,
+                             "refine_global(" + std::to_string(ref_level) +
+                               ")",
+                             [&]() { triangulation.refine_global(ref_level); });
 
   std::cout << "Number of active cells: " << triangulation.n_active_cells()
             << std::endl;
@@ -190,11 +213,20 @@ Step3<dim>::setup_system()
                                            constraints);
   constraints.close();
 
-  DynamicSparsityPattern dsp(dof_handler.n_dofs());
-  DoFTools::make_sparsity_pattern(dof_handler, dsp, constraints);
-  sparsity_pattern.copy_from(dsp);
-
-  system_matrix.reinit(sparsity_pattern);
+  // The matrix keeps its own copy of the upper triangle, so the full
+  // pattern is only needed to set it up.
+  {
+    SparsityPattern sparsity_pattern;
+    build_sparsity_pattern(dof_handler, sparsity_pattern, constraints);
+
+    system_matrix.reinit(sparsity_pattern);
+    std::cout << "Matrix memory: " << system_matrix.memory_consumption()
+              << " bytes for " << system_matrix.n_nonzero_elements()
+              << " stored entries, SparseMatrix<double>: "
+              << sparsity_pattern.memory_consumption() +
+                   sparsity_pattern.n_nonzero_elements() * sizeof(double)
+              << " bytes for pattern and values" << std::endl;
+  }
 
   solution.reinit(dof_handler.n_dofs());
   system_rhs.reinit(dof_handler.n_dofs());
@@ -299,6 +331,14 @@ void
 Step3<dim>::output_results(const unsigned int cycle) const
 {
   TimerOutput::Scope timer_section(timer, "Output results");
+#ifdef DEAL_II_WITH_HDF5
+  hdf5_writer.clear_data_vectors();
+  hdf5_writer.add_data_vector(solution, "solution");
+  hdf5_writer.add_data_vector(L2_error_per_cell, "L2_error");
+  hdf5_writer.add_data_vector(H1_error_per_cell, "H1_error");
+  hdf5_writer.add_data_vector(error_estimator, "Error_estimator");
+  hdf5_writer.write(cycle);
+#else
   DataOut<dim>       data_out;
   data_out.attach_dof_handler(dof_handler);
   data_out.add_data_vector(solution, "solution");
@@ -309,6 +349,7 @@ Step3<dim>::output_results(const unsigned int cycle) const
 
   std::ofstream output("solution_" + std::to_string(cycle) + ".vtu");
   data_out.write_vtu(output);
+#endif
 }
 
 
@@ -345,11 +386,14 @@ Step3<dim>::run(const unsigned int n_cycles,
 
 
 int
-main()
+main(int argc, char **argv)
 {
   deallog.depth_console(2);
 
-  Step3<2> laplace_problem;
+  // Pass --no-cache to ignore the mesh cache, or --refresh-cache to rebuild
+  // its entries.
+  Step3<2> laplace_problem(
+    TriangulationCache::mode_from_command_line(argc, argv));
   laplace_problem.run(8);
 
   return 0;
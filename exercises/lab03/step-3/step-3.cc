@@ -34,6 +34,9 @@
 
 #include <deal.II/fe/fe_values.h>
 #include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/mpi.h>
+#include <deal.II/base/table_handler.h>
+#include <deal.II/base/timer.h>
 
 #include <deal.II/base/function.h>
 #include <deal.II/numerics/vector_tools.h>
@@ -42,25 +45,265 @@
 #include <deal.II/lac/vector.h>
 #include <deal.II/lac/full_matrix.h>
 #include <deal.II/lac/sparse_matrix.h>
-#include <deal.II/lac/dynamic_sparsity_pattern.h>
 #include <deal.II/lac/solver_cg.h>
 #include <deal.II/lac/precondition.h>
+#include <deal.II/lac/affine_constraints.h>
+#include <deal.II/lac/diagonal_matrix.h>
+#include <deal.II/lac/la_parallel_vector.h>
+
+#include <deal.II/matrix_free/matrix_free.h>
+#include <deal.II/matrix_free/fe_evaluation.h>
+#include <deal.II/matrix_free/operators.h>
 
 #include <deal.II/numerics/data_out.h>
+
+#include <assembly_kernels.h>
+#include <batched_scatter.h>
+#include <bsr_matrix.h>
+#include <cell_matrix_cache.h>
+#include <direct_sparsity_builder.h>
+#include <hdf5_xdmf_writer.h>
+#include <mixed_precision_cg.h>
+#include <preconditioner_factory.h>
+#include <triangulation_cache.h>
+
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <string>
 
 using namespace dealii;
 
 
 
+// The storage format of the system matrix: deal.II's SparseMatrix, with one
+// column index per entry, a BSRMatrix, with one column index per pair of
+// coupled blocks of DoFs, which pays off for higher polynomial degrees, or
+// no matrix at all: the matrix-free LaplaceOperator evaluates the action of
+// the matrix cell by cell with sum factorization, on batches of cells that
+// fill the SIMD lanes of a VectorizedArray.
+enum class MatrixFormat
+{
+  csr,
+  bsr,
+  matrix_free
+};
+
+
+
+// What a matrix-free solve reports back: the time to set up the operator,
+// its diagonal and the right hand side, the time of the CG solve, and the
+// number of CG iterations.
+struct MatrixFreeStatistics
+{
+  double       setup_time;
+  double       solve_time;
+  unsigned int n_iterations;
+};
+
+
+
+// Solves the problem of Step3 for FE_Q<2>(degree) without assembling a
+// matrix. The degree has to be known at compile time for the sum
+// factorization kernels, hence the template argument and the dispatch below.
+// The preconditioner is the inverse of the diagonal of the operator, either
+// directly (point Jacobi) or inside a Chebyshev polynomial.
+template <int degree>
+MatrixFreeStatistics
+solve_matrix_free (const DoFHandler<2> &dof_handler,
+                   const bool           use_chebyshev,
+                   Vector<double>      &solution)
+{
+  typedef LinearAlgebra::distributed::Vector<double> VectorType;
+  typedef MatrixFreeOperators::LaplaceOperator<2, degree, degree+1, 1,
+          VectorType> OperatorType;
+
+  MatrixFreeStatistics statistics;
+  Timer timer;
+
+  AffineConstraints<double> constraints;
+  VectorTools::interpolate_boundary_values (dof_handler,
+                                            0,
+                                            ZeroFunction<2>(),
+                                            constraints);
+  constraints.close ();
+
+  typename MatrixFree<2,double>::AdditionalData additional_data;
+  additional_data.mapping_update_flags = (update_values | update_gradients |
+                                          update_JxW_values);
+  std::shared_ptr<MatrixFree<2,double> > matrix_free (new MatrixFree<2,double>());
+  matrix_free->reinit (dof_handler, constraints, QGauss<1>(degree+1),
+                       additional_data);
+
+  OperatorType laplace_operator;
+  laplace_operator.initialize (matrix_free);
+  laplace_operator.compute_diagonal ();
+
+  VectorType x, rhs;
+  matrix_free->initialize_dof_vector (x);
+  matrix_free->initialize_dof_vector (rhs);
+
+  FEEvaluation<2,degree> phi (*matrix_free);
+  for (unsigned int cell=0; cell<matrix_free->n_macro_cells(); ++cell)
+    {
+      phi.reinit (cell);
+      for (unsigned int q=0; q<phi.n_q_points; ++q)
+        phi.submit_value (make_vectorized_array<double> (1.), q);
+      phi.integrate (true, false);
+      phi.distribute_local_to_global (rhs);
+    }
+  rhs.compress (VectorOperation::add);
+
+  statistics.setup_time = timer.wall_time();
+  timer.restart ();
+
+  SolverControl        solver_control (1000, 1e-12);
+  SolverCG<VectorType> solver (solver_control);
+  if (use_chebyshev)
+    {
+      typedef PreconditionChebyshev<OperatorType,VectorType> Preconditioner;
+      typename Preconditioner::AdditionalData chebyshev_data;
+      chebyshev_data.preconditioner
+        = laplace_operator.get_matrix_diagonal_inverse();
+      chebyshev_data.degree          = 5;
+      chebyshev_data.smoothing_range = 1e3;
+
+      Preconditioner preconditioner;
+      preconditioner.initialize (laplace_operator, chebyshev_data);
+      solver.solve (laplace_operator, x, rhs, preconditioner);
+    }
+  else
+    solver.solve (laplace_operator, x, rhs,
+                  *laplace_operator.get_matrix_diagonal_inverse());
+  constraints.distribute (x);
+
+  statistics.solve_time   = timer.wall_time();
+  statistics.n_iterations = solver_control.last_step();
+
+  solution.reinit (dof_handler.n_dofs());
+  for (types::global_dof_index i=0; i<dof_handler.n_dofs(); ++i)
+    solution(i) = x(i);
+
+  return statistics;
+}
+
+
+
+MatrixFreeStatistics
+dispatch_matrix_free_solve (const DoFHandler<2> &dof_handler,
+                            const bool           use_chebyshev,
+                            Vector<double>      &solution)
+{
+  switch (dof_handler.get_fe().degree)
+    {
+    case 1:
+      return solve_matrix_free<1> (dof_handler, use_chebyshev, solution);
+    case 2:
+      return solve_matrix_free<2> (dof_handler, use_chebyshev, solution);
+    case 3:
+      return solve_matrix_free<3> (dof_handler, use_chebyshev, solution);
+    case 4:
+      return solve_matrix_free<4> (dof_handler, use_chebyshev, solution);
+    case 5:
+      return solve_matrix_free<5> (dof_handler, use_chebyshev, solution);
+    case 6:
+      return solve_matrix_free<6> (dof_handler, use_chebyshev, solution);
+    default:
+      AssertThrow (false,
+                   ExcMessage ("The matrix-free path supports degrees 1 to 6."));
+    }
+  return MatrixFreeStatistics();
+}
+
+
+
+// The run-time options of Step3, set from the command line in main(). Not
+// all of them can be combined: check() throws for combinations where an
+// option would be ignored.
+struct Step3Options
+{
+  Step3Options ();
+
+  void check () const;
+
+  unsigned int degree;
+  MatrixFormat format;
+
+  // Precondition the matrix-free solve with a Chebyshev polynomial instead
+  // of point Jacobi.
+  bool         use_chebyshev;
+
+  // Reuse the cell matrices of cells that are translated or scaled copies
+  // of each other, see CellMatrixCache.
+  bool         cache_cell_matrices;
+
+  // Assemble the CSR matrix with the kernels of assembly_kernels.h, which
+  // are compiled for each of the degrees 1 to 4, instead of with FEValues.
+  bool         use_assembly_kernels;
+
+  // Solve the CSR system with MixedPrecisionCG, i.e. with single precision
+  // CG iterations inside a double precision defect correction.
+  bool         use_mixed_precision;
+};
+
+
+Step3Options::Step3Options ()
+  :
+  degree (1),
+  format (MatrixFormat::csr),
+  use_chebyshev (false),
+  cache_cell_matrices (false),
+  use_assembly_kernels (false),
+  use_mixed_precision (false)
+{}
+
+
+
+void Step3Options::check () const
+{
+  AssertThrow (!use_chebyshev || format == MatrixFormat::matrix_free,
+               ExcMessage ("--chebyshev needs --matrix-free."));
+  AssertThrow (!cache_cell_matrices || format != MatrixFormat::matrix_free,
+               ExcMessage ("--cache-cell-matrices needs an assembled "
+                           "matrix."));
+  AssertThrow (!use_assembly_kernels || format == MatrixFormat::csr,
+               ExcMessage ("--assembly-kernels needs the CSR matrix."));
+  AssertThrow (!use_assembly_kernels || (degree >= 1 && degree <= 4),
+               ExcMessage ("--assembly-kernels exist for degrees 1 to 4."));
+  AssertThrow (!use_assembly_kernels || !cache_cell_matrices,
+               ExcMessage ("--assembly-kernels and --cache-cell-matrices "
+                           "cannot be combined, the kernels compute every "
+                           "cell matrix."));
+  AssertThrow (!use_mixed_precision || format == MatrixFormat::csr,
+               ExcMessage ("--mixed-precision needs the CSR matrix."));
+}
+
+
+
 class Step3
 {
 public:
-  Step3 ();
+  Step3 (const TriangulationCache::Mode cache_mode
+         = TriangulationCache::Mode::use,
+         const Step3Options &options = Step3Options(),
+         const PreconditionerFactory &preconditioner_factory
+         = PreconditionerFactory ("identity"));
 
   void run ();
 
+  // Add the timings of the last run() as a row of the table.
+  void add_timings (TableHandler &table) const;
+
+  // Add the index and value memory of the assembled matrix and the time of
+  // one matrix-vector product as a row of the table.
+  void add_matrix_report (TableHandler &table) const;
+
+  // Add the resident memory of the matrices and vectors of the solve, the
+  // time to solution and the relative residual of the last run() as a row
+  // of the table.
+  void add_precision_report (TableHandler &table) const;
+
 
 private:
   void make_grid ();
@@ -69,6 +312,14 @@ private:
   void solve ();
   void output_results () const;
 
+  TriangulationCache   triangulation_cache;
+
+  const Step3Options   options;
+
+  // The preconditioner of the CSR matrix. The BSR matrix is only solved
+  // without one, and the matrix-free operator chooses its own.
+  const PreconditionerFactory preconditioner_factory;
+
   Triangulation<2>     triangulation;
   FE_Q<2>              fe;
   DoFHandler<2>        dof_handler;
@@ -76,23 +327,70 @@ private:
   SparsityPattern      sparsity_pattern;
   SparseMatrix<double> system_matrix;
 
+  BSRSparsityPattern   bsr_sparsity_pattern;
+  BSRMatrix<double>    bsr_matrix;
+
   Vector<double>       solution;
   Vector<double>       system_rhs;
+
+  double               setup_time;
+  double               assembly_time;
+  double               preconditioner_setup_time;
+  double               solve_time;
+  unsigned int         n_iterations;
+
+  // The bytes of all matrices and vectors held during the solve, including
+  // the SparsityPattern and, for mixed precision, both the double matrix and
+  // its float copy, and the final residual relative to the right hand side.
+  // Only set for CSR.
+  std::size_t          resident_memory;
+  double               relative_residual;
 };
 
 
-Step3::Step3 ()
+Step3::Step3 (const TriangulationCache::Mode cache_mode,
+              const Step3Options &options,
+              const PreconditionerFactory &preconditioner_factory)
   :
-  fe (1),
-  dof_handler (triangulation)
-{}
+  triangulation_cache (cache_mode),
+  options (options),
+  preconditioner_factory (preconditioner_factory),
+  fe (options.degree),
+  dof_handler (triangulation),
+  preconditioner_setup_time (0.)
+{
+  options.check ();
+  AssertThrow (options.format != MatrixFormat::bsr ||
+               preconditioner_factory.get_type() == "identity",
+               ExcMessage ("The BSR matrix is only solved without a "
+                           "preconditioner, --preconditioner="
+                           + preconditioner_factory.get_type() +
+                           " needs the CSR matrix."));
+  AssertThrow (options.format != MatrixFormat::matrix_free ||
+               preconditioner_factory.get_type() == "identity",
+               ExcMessage ("The matrix-free solver is preconditioned with "
+                           "Jacobi or, with --chebyshev, Chebyshev, "
+                           "--preconditioner="
+                           + preconditioner_factory.get_type() +
+                           " needs the CSR matrix."));
+  AssertThrow (!options.use_mixed_precision ||
+               (preconditioner_factory.get_type() == "ssor" &&
+                preconditioner_factory.get_ssor_relaxations().size() == 1),
+               ExcMessage ("MixedPrecisionCG is preconditioned with SSOR, "
+                           "--mixed-precision needs --preconditioner=ssor "
+                           "with a single relaxation parameter."));
+}
 
 
 
 void Step3::make_grid ()
 {
   GridGenerator::hyper_cube (triangulation, -1, 1);
-  triangulation.refine_global (5);
+  triangulation_cache.refine (triangulation, "refine_global(5)",
+                              [&] ()
+  {
+    triangulation.refine_global (5);
+  });
 
   std::cout << "Number of active cells: "
             << triangulation.n_active_cells()
@@ -109,11 +407,32 @@ void Step3::setup_system ()
             << dof_handler.n_dofs()
             << std::endl;
 
-  DynamicSparsityPattern dsp(dof_handler.n_dofs());
-  DoFTools::make_sparsity_pattern (dof_handler, dsp);
-  sparsity_pattern.copy_from(dsp);
-
-  system_matrix.reinit (sparsity_pattern);
+  if (options.format == MatrixFormat::bsr)
+    {
+      // This renumbers the DoFs so that each block is contiguous.
+      bsr_sparsity_pattern.reinit (dof_handler);
+      bsr_matrix.reinit (bsr_sparsity_pattern);
+
+      std::cout << "BSR matrix: " << bsr_sparsity_pattern.n_blocks()
+                << " blocks of DoFs, "
+                << bsr_sparsity_pattern.n_nonzero_blocks()
+                << " nonzero blocks, "
+                << bsr_sparsity_pattern.memory_consumption() +
+                bsr_matrix.memory_consumption()
+                << " bytes" << std::endl;
+    }
+  else if (options.format == MatrixFormat::csr)
+    {
+      build_sparsity_pattern (dof_handler, sparsity_pattern);
+      system_matrix.reinit (sparsity_pattern);
+
+      std::cout << "CSR matrix: "
+                << sparsity_pattern.n_nonzero_elements()
+                << " nonzero entries, "
+                << sparsity_pattern.memory_consumption() +
+                system_matrix.memory_consumption()
+                << " bytes" << std::endl;
+    }
 
   solution.reinit (dof_handler.n_dofs());
   system_rhs.reinit (dof_handler.n_dofs());
@@ -123,50 +442,82 @@ void Step3::setup_system ()
 
 void Step3::assemble_system ()
 {
-  QGauss<2>  quadrature_formula(2);
-  FEValues<2> fe_values (fe, quadrature_formula,
-                         update_values | update_gradients | update_JxW_values);
-
-  const unsigned int   dofs_per_cell = fe.dofs_per_cell;
-  const unsigned int   n_q_points    = quadrature_formula.size();
+  // The matrix-free operator integrates its right hand side itself.
+  if (options.format == MatrixFormat::matrix_free)
+    return;
+
+  // The specialized kernels assemble the CSR matrix of FE_Q of degree 1 to
+  // 4, which Step3Options::check() ensures. Without them, the generic loop
+  // below assembles every format and degree.
+  if (options.format == MatrixFormat::csr && options.use_assembly_kernels)
+    dispatch_laplace_assembly (dof_handler, UnitCoefficient(), 1.,
+                               system_matrix, system_rhs);
+  else
+    {
+      QGauss<2>  quadrature_formula(fe.degree+1);
+      FEValues<2> fe_values (fe, quadrature_formula,
+                             update_values | update_gradients |
+                             update_JxW_values);
 
-  FullMatrix<double>   cell_matrix (dofs_per_cell, dofs_per_cell);
-  Vector<double>       cell_rhs (dofs_per_cell);
+      const unsigned int   dofs_per_cell = fe.dofs_per_cell;
+      const unsigned int   n_q_points    = quadrature_formula.size();
 
-  std::vector<types::global_dof_index> local_dof_indices (dofs_per_cell);
+      FullMatrix<double>   cell_matrix (dofs_per_cell, dofs_per_cell);
+      Vector<double>       cell_rhs (dofs_per_cell);
 
-  DoFHandler<2>::active_cell_iterator cell = dof_handler.begin_active();
-  DoFHandler<2>::active_cell_iterator endc = dof_handler.end();
-  for (; cell!=endc; ++cell)
-    {
-      fe_values.reinit (cell);
+      std::vector<types::global_dof_index> local_dof_indices (dofs_per_cell);
 
-      cell_matrix = 0;
-      cell_rhs = 0;
+      BatchedScatter scatter;
+      CellMatrixCache<2> cell_matrix_cache;
 
-      for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+      DoFHandler<2>::active_cell_iterator cell = dof_handler.begin_active();
+      DoFHandler<2>::active_cell_iterator endc = dof_handler.end();
+      for (; cell!=endc; ++cell)
         {
-          for (unsigned int i=0; i<dofs_per_cell; ++i)
-            for (unsigned int j=0; j<dofs_per_cell; ++j)
-              cell_matrix(i,j) += (fe_values.shape_grad (i, q_index) *
-                                   fe_values.shape_grad (j, q_index) *
-                                   fe_values.JxW (q_index));
-
-          for (unsigned int i=0; i<dofs_per_cell; ++i)
-            cell_rhs(i) += (fe_values.shape_value (i, q_index) *
-                            1 *
-                            fe_values.JxW (q_index));
+          if (!options.cache_cell_matrices ||
+              !cell_matrix_cache.lookup (cell, cell_matrix, cell_rhs))
+            {
+              fe_values.reinit (cell);
+
+              cell_matrix = 0;
+              cell_rhs = 0;
+
+              for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+                {
+                  for (unsigned int i=0; i<dofs_per_cell; ++i)
+                    for (unsigned int j=0; j<dofs_per_cell; ++j)
+                      cell_matrix(i,j) += (fe_values.shape_grad (i, q_index) *
+                                           fe_values.shape_grad (j, q_index) *
+                                           fe_values.JxW (q_index));
+
+                  for (unsigned int i=0; i<dofs_per_cell; ++i)
+                    cell_rhs(i) += (fe_values.shape_value (i, q_index) *
+                                    1 *
+                                    fe_values.JxW (q_index));
+                }
+
+              if (options.cache_cell_matrices)
+                cell_matrix_cache.store (cell, cell_matrix, cell_rhs);
+            }
+          cell->get_dof_indices (local_dof_indices);
+
+          if (options.format == MatrixFormat::bsr)
+            {
+              bsr_matrix.add (local_dof_indices, cell_matrix);
+              for (unsigned int i=0; i<dofs_per_cell; ++i)
+                system_rhs(local_dof_indices[i]) += cell_rhs(i);
+            }
+          else
+            scatter.add (cell_matrix, cell_rhs, local_dof_indices,
+                         system_matrix, system_rhs);
         }
-      cell->get_dof_indices (local_dof_indices);
 
-      for (unsigned int i=0; i<dofs_per_cell; ++i)
-        for (unsigned int j=0; j<dofs_per_cell; ++j)
-          system_matrix.add (local_dof_indices[i],
-                             local_dof_indices[j],
-                             cell_matrix(i,j));
-
-      for (unsigned int i=0; i<dofs_per_cell; ++i)
-        system_rhs(local_dof_indices[i]) += cell_rhs(i);
+      if (options.cache_cell_matrices)
+        std::cout << "Cell matrix cache: " << cell_matrix_cache.n_hits()
+                  << " of " << triangulation.n_active_cells()
+                  << " cell matrices reused, "
+                  << cell_matrix_cache.n_misses() << " computed"
+                  << std::endl;
     }
 
 
@@ -175,10 +526,15 @@ void Step3::assemble_system ()
                                             0,
                                             ZeroFunction<2>(),
                                             boundary_values);
-  MatrixTools::apply_boundary_values (boundary_values,
-                                      system_matrix,
+  if (options.format == MatrixFormat::bsr)
+    bsr_matrix.apply_boundary_values (boundary_values,
                                       solution,
                                       system_rhs);
+  else
+    MatrixTools::apply_boundary_values (boundary_values,
+                                        system_matrix,
+                                        solution,
+                                        system_rhs);
 }
 
 
@@ -188,14 +544,87 @@ void Step3::solve ()
   SolverControl           solver_control (1000, 1e-12);
   SolverCG<>              solver (solver_control);
 
-  solver.solve (system_matrix, solution, system_rhs,
-                PreconditionIdentity());
+  Timer timer;
+  if (options.format == MatrixFormat::matrix_free)
+    {
+      const MatrixFreeStatistics statistics
+        = dispatch_matrix_free_solve (dof_handler, options.use_chebyshev,
+                                      solution);
+
+      // Setting up the operator takes the place of assembly.
+      assembly_time = statistics.setup_time;
+      solve_time    = statistics.solve_time;
+      n_iterations  = statistics.n_iterations;
+    }
+  else if (options.format == MatrixFormat::bsr)
+    {
+      solver.solve (bsr_matrix, solution, system_rhs,
+                    PreconditionIdentity());
+
+      solve_time   = timer.wall_time();
+      n_iterations = solver_control.last_step();
+    }
+  else if (options.use_mixed_precision)
+    {
+      MixedPrecisionCG::AdditionalData additional_data;
+      additional_data.relaxation
+        = preconditioner_factory.get_ssor_relaxations()[0];
+      MixedPrecisionCG mixed_precision_solver (solver_control,
+                                               additional_data);
+      mixed_precision_solver.solve (system_matrix, solution, system_rhs);
+
+      solve_time   = timer.wall_time();
+      n_iterations = mixed_precision_solver.n_inner_iterations();
+      // The double system stays alive next to the float copy, and the
+      // inner SolverCG allocates three float vectors.
+      resident_memory = sparsity_pattern.memory_consumption() +
+                        system_matrix.memory_consumption() +
+                        solution.memory_consumption() +
+                        system_rhs.memory_consumption() +
+                        mixed_precision_solver.memory_consumption() +
+                        3 * dof_handler.n_dofs() * sizeof(float);
+
+      std::cout << mixed_precision_solver.n_outer_iterations()
+                << " steps of defect correction" << std::endl;
+    }
+  else
+    {
+      const PreconditionerFactory::SolveStatistics statistics
+        = preconditioner_factory.solve (system_matrix, solution,
+                                        system_rhs, solver_control);
+      preconditioner_setup_time = statistics.setup_time;
+      solve_time                = statistics.solve_time;
+      n_iterations              = statistics.n_iterations;
+      // SolverCG allocates three auxiliary vectors. The memory of the
+      // preconditioner is left out on both paths.
+      resident_memory           = sparsity_pattern.memory_consumption() +
+                                  system_matrix.memory_consumption() +
+                                  solution.memory_consumption() +
+                                  system_rhs.memory_consumption() +
+                                  3 * solution.memory_consumption();
+    }
+
+  if (options.format == MatrixFormat::csr)
+    {
+      Vector<double> residual (dof_handler.n_dofs());
+      relative_residual = system_matrix.residual (residual, solution,
+                                                  system_rhs) /
+                          system_rhs.l2_norm();
+    }
+
+  std::cout << n_iterations << " CG iterations in "
+            << solve_time << "s" << std::endl;
 }
 
 
 
 void Step3::output_results () const
 {
+#ifdef DEAL_II_WITH_HDF5
+  HDF5XDMFWriter<2> writer (dof_handler, "solution");
+  writer.add_data_vector (solution, "solution");
+  writer.write (0.);
+#else
   DataOut<2> data_out;
   data_out.attach_dof_handler (dof_handler);
   data_out.add_data_vector (solution, "solution");
@@ -203,6 +632,7 @@ void Step3::output_results () const
 
   std::ofstream output ("solution.gpl");
   data_out.write_gnuplot (output);
+#endif
 }
 
 
@@ -210,19 +640,264 @@ void Step3::output_results () const
 void Step3::run ()
 {
   make_grid ();
+
+  Timer timer;
   setup_system ();
+  setup_time = timer.wall_time();
+
+  timer.restart ();
   assemble_system ();
+  assembly_time = timer.wall_time();
+
   solve ();
   output_results ();
 }
 
 
 
-int main ()
+void Step3::add_timings (TableHandler &table) const
+{
+  const char *format_names[] = {"csr", "bsr", "matrix_free"};
+
+  table.add_value ("degree", fe.degree);
+  table.add_value ("format",
+                   std::string (format_names[static_cast<int>
+                                             (options.format)]));
+  table.add_value ("n_dofs", dof_handler.n_dofs());
+  table.add_value ("preconditioner_type",
+                   options.format != MatrixFormat::matrix_free ?
+                   preconditioner_factory.get_type() :
+                   std::string (options.use_chebyshev ?
+                                "chebyshev" : "jacobi"));
+  table.add_value ("setup", setup_time);
+  table.add_value ("assembly", assembly_time);
+  table.add_value ("preconditioner", preconditioner_setup_time);
+  table.add_value ("solve", solve_time);
+  table.add_value ("iterations", n_iterations);
+  table.add_value ("per_iteration",
+                   solve_time / std::max (n_iterations, 1u));
+}
+
+
+
+void Step3::add_matrix_report (TableHandler &table) const
 {
+  Assert (options.format != MatrixFormat::matrix_free, ExcNotImplemented());
+
+  Vector<double> src (dof_handler.n_dofs()), dst (dof_handler.n_dofs());
+  src = 1.;
+  const unsigned int n_repetitions = 20;
+
+  std::size_t n_nonzeros, index_memory, value_memory;
+  Timer timer;
+  if (options.format == MatrixFormat::bsr)
+    {
+      for (unsigned int i=0; i<n_repetitions; ++i)
+        bsr_matrix.vmult (dst, src);
+      n_nonzeros   = bsr_sparsity_pattern.n_nonzero_elements();
+      index_memory = bsr_sparsity_pattern.memory_consumption();
+      value_memory = bsr_matrix.memory_consumption();
+    }
+  else
+    {
+      for (unsigned int i=0; i<n_repetitions; ++i)
+        system_matrix.vmult (dst, src);
+      n_nonzeros   = sparsity_pattern.n_nonzero_elements();
+      index_memory = sparsity_pattern.memory_consumption();
+      value_memory = system_matrix.memory_consumption();
+    }
+  const double spmv_time = timer.wall_time() / n_repetitions;
+
+  table.add_value ("degree", fe.degree);
+  table.add_value ("format",
+                   std::string (options.format == MatrixFormat::bsr ?
+                                "bsr" : "csr"));
+  table.add_value ("n_dofs", dof_handler.n_dofs());
+  table.add_value ("nonzeros",
+                   static_cast<unsigned long long int> (n_nonzeros));
+  table.add_value ("index_bytes",
+                   static_cast<unsigned long long int> (index_memory));
+  table.add_value ("index_per_entry",
+                   static_cast<double> (index_memory) / n_nonzeros);
+  table.add_value ("value_bytes",
+                   static_cast<unsigned long long int> (value_memory));
+  table.add_value ("spmv", spmv_time);
+}
+
+
+
+void Step3::add_precision_report (TableHandler &table) const
+{
+  table.add_value ("precision",
+                   std::string (options.use_mixed_precision ?
+                                "mixed" : "double"));
+  table.add_value ("n_dofs", dof_handler.n_dofs());
+  table.add_value ("resident_memory",
+                   static_cast<unsigned long long int> (resident_memory));
+  table.add_value ("solve", solve_time);
+  table.add_value ("iterations", n_iterations);
+  table.add_value ("residual", relative_residual);
+}
+
+
+
+int main (int argc, char **argv)
+{
+  // The matrix-free vectors are MPI vectors, even on a single process.
+  Utilities::MPI::MPI_InitFinalize mpi_initialization (argc, argv, -1);
+
   deallog.depth_console (2);
 
-  Step3 laplace_problem;
+  // Pass --no-cache to ignore the mesh cache, or --refresh-cache to rebuild
+  // its entries. --degree=<p> sets the degree of the finite element, --bsr
+  // stores the matrix in block compressed rows, and --matrix-free uses no
+  // matrix at all, with a Jacobi or, with --chebyshev, a Chebyshev
+  // preconditioner. --compare-matrix-free runs the assembled and the
+  // matrix-free solvers for degrees 1 to 6 and tabulates their timings.
+  // The preconditioner of the CSR matrix is chosen with
+  // --preconditioner=<type> or in a --parameters=<file>, see
+  // PreconditionerFactory. --cache-cell-matrices computes the matrix of
+  // all cells of the same shape only once, and --assembly-kernels uses
+  // assembly loops specialized for the degree. --mixed-precision runs the
+  // CG iterations in single precision, with SSOR and the relaxation of
+  // --preconditioner=ssor as preconditioner, and --compare-mixed-precision
+  // compares this with the double precision solver. --compare-bsr
+  // tabulates the index memory and the matrix-vector product time of the
+  // CSR and BSR formats for degrees 1 to 6.
+  const TriangulationCache::Mode cache_mode
+    = TriangulationCache::mode_from_command_line (argc, argv);
+  Step3Options options;
+  bool compare = false;
+  bool compare_precision = false;
+  bool compare_bsr = false;
+  PreconditionerFactory preconditioner_factory ("identity");
+  preconditioner_factory.parse_command_line (argc, argv);
+  for (int i=1; i<argc; ++i)
+    {
+      const std::string argument = argv[i];
+      if (argument.compare (0, 9, "--degree=") == 0)
+        options.degree = std::stoi (argument.substr (9));
+      else if (argument == "--bsr")
+        options.format = MatrixFormat::bsr;
+      else if (argument == "--matrix-free")
+        options.format = MatrixFormat::matrix_free;
+      else if (argument == "--chebyshev")
+        options.use_chebyshev = true;
+      else if (argument == "--compare-matrix-free")
+        compare = true;
+      else if (argument == "--cache-cell-matrices")
+        options.cache_cell_matrices = true;
+      else if (argument == "--assembly-kernels")
+        options.use_assembly_kernels = true;
+      else if (argument == "--mixed-precision")
+        options.use_mixed_precision = true;
+      else if (argument == "--compare-mixed-precision")
+        compare_precision = true;
+      else if (argument == "--compare-bsr")
+        compare_bsr = true;
+    }
+
+  if (compare)
+    {
+      // The options of the assembled matrix apply to the CSR runs, the
+      // assembly kernels only up to degree 4, and --preconditioner as well.
+      // The matrix-free runs use Jacobi or, with --chebyshev, Chebyshev.
+      // The preconditioner_type column says which one each row used.
+      TableHandler table;
+      for (unsigned int p=1; p<=6; ++p)
+        for (const MatrixFormat f : {MatrixFormat::csr,
+                                     MatrixFormat::matrix_free
+                                    })
+          {
+            Step3Options run_options = options;
+            run_options.degree = p;
+            run_options.format = f;
+            if (f == MatrixFormat::csr)
+              {
+                run_options.use_chebyshev = false;
+                if (p > 4)
+                  run_options.use_assembly_kernels = false;
+              }
+            else
+              {
+                run_options.cache_cell_matrices  = false;
+                run_options.use_assembly_kernels = false;
+                run_options.use_mixed_precision  = false;
+              }
+
+            Step3 laplace_problem (cache_mode, run_options,
+                                   f == MatrixFormat::csr ?
+                                   preconditioner_factory :
+                                   PreconditionerFactory ("identity"));
+            laplace_problem.run ();
+            laplace_problem.add_timings (table);
+          }
+
+      for (const std::string column : {"setup", "assembly", "preconditioner",
+                                       "solve", "per_iteration"
+                                      })
+        table.set_scientific (column, true);
+      table.write_text (std::cout, TableHandler::org_mode_table);
+
+      std::ofstream out ("matrix-free-comparison.txt");
+      table.write_text (out);
+      return 0;
+    }
+
+  if (compare_bsr)
+    {
+      TableHandler table;
+      for (unsigned int p=1; p<=6; ++p)
+        for (const MatrixFormat f : {MatrixFormat::csr, MatrixFormat::bsr})
+          {
+            Step3Options run_options;
+            run_options.degree              = p;
+            run_options.format              = f;
+            run_options.cache_cell_matrices = options.cache_cell_matrices;
+
+            Step3 laplace_problem (cache_mode, run_options,
+                                   PreconditionerFactory ("identity"));
+            laplace_problem.run ();
+            laplace_problem.add_matrix_report (table);
+          }
+
+      table.set_precision ("index_per_entry", 2);
+      table.set_scientific ("spmv", true);
+      table.write_text (std::cout, TableHandler::org_mode_table);
+
+      std::ofstream out ("bsr-comparison.txt");
+      table.write_text (out);
+      return 0;
+    }
+
+  if (compare_precision)
+    {
+      // Both paths use SSOR(1.2), so that only the precision differs.
+      const PreconditionerFactory ssor ("ssor");
+
+      TableHandler table;
+      for (const bool mixed : {false, true})
+        {
+          Step3Options run_options = options;
+          run_options.format              = MatrixFormat::csr;
+          run_options.use_chebyshev       = false;
+          run_options.use_mixed_precision = mixed;
+
+          Step3 laplace_problem (cache_mode, run_options, ssor);
+          laplace_problem.run ();
+          laplace_problem.add_precision_report (table);
+        }
+
+      table.set_scientific ("solve", true);
+      table.set_scientific ("residual", true);
+      table.write_text (std::cout, TableHandler::org_mode_table);
+
+      std::ofstream out ("mixed-precision-comparison.txt");
+      table.write_text (out);
+      return 0;
+    }
+
+  Step3 laplace_problem (cache_mode, options, preconditioner_factory);
   laplace_problem.run ();
 
   return 0;
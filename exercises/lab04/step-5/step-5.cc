@@ -22,10 +22,10 @@
 #include <deal.II/base/quadrature_lib.h>
 #include <deal.II/base/function.h>
 #include <deal.II/base/logstream.h>
+#include <deal.II/base/mpi.h>
 #include <deal.II/lac/vector.h>
 #include <deal.II/lac/full_matrix.h>
 #include <deal.II/lac/sparse_matrix.h>
-#include <deal.II/lac/dynamic_sparsity_pattern.h>
 #include <deal.II/lac/solver_cg.h>
 #include <deal.II/lac/precondition.h>
 #include <deal.II/grid/tria.h>
@@ -44,9 +44,16 @@
 
 #include <deal.II/grid/manifold_lib.h>
 
+#include <assembly_kernels.h>
+#include <batched_scatter.h>
+#include <cached_manifold.h>
+#include <direct_sparsity_builder.h>
+#include <preconditioner_factory.h>
+
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <string>
 
 using namespace dealii;
 
@@ -56,7 +63,9 @@ template <int dim>
 class Step5
 {
 public:
-  Step5 ();
+  Step5 (const bool use_assembly_kernels = false,
+         const PreconditionerFactory &preconditioner_factory
+         = PreconditionerFactory());
   void run ();
 
 private:
@@ -74,6 +83,11 @@ private:
 
   Vector<double>       solution;
   Vector<double>       system_rhs;
+
+  // Assemble with the kernels of assembly_kernels.h instead of FEValues.
+  const bool           use_assembly_kernels;
+
+  const PreconditionerFactory preconditioner_factory;
 };
 
 
@@ -91,9 +105,12 @@ double coefficient (const Point<dim> &p)
 
 
 template <int dim>
-Step5<dim>::Step5 () :
+Step5<dim>::Step5 (const bool use_assembly_kernels,
+                   const PreconditionerFactory &preconditioner_factory) :
   fe (1),
-  dof_handler (triangulation)
+  dof_handler (triangulation),
+  use_assembly_kernels (use_assembly_kernels),
+  preconditioner_factory (preconditioner_factory)
 {}
 
 
@@ -108,9 +125,7 @@ void Step5<dim>::setup_system ()
             << dof_handler.n_dofs()
             << std::endl;
 
-  DynamicSparsityPattern dsp(dof_handler.n_dofs());
-  DoFTools::make_sparsity_pattern (dof_handler, dsp);
-  sparsity_pattern.copy_from(dsp);
+  build_sparsity_pattern (dof_handler, sparsity_pattern);
 
   system_matrix.reinit (sparsity_pattern);
 
@@ -124,58 +139,59 @@ void Step5<dim>::setup_system ()
 template <int dim>
 void Step5<dim>::assemble_system ()
 {
-  QGauss<dim>  quadrature_formula(2);
-
-  FEValues<dim> fe_values (fe, quadrature_formula,
-                           update_values    |  update_gradients |
-                           update_quadrature_points  |  update_JxW_values);
+  if (use_assembly_kernels)
+    dispatch_laplace_assembly (dof_handler, &coefficient<dim>, 1.,
+                               system_matrix, system_rhs);
+  else
+    {
+      QGauss<dim>  quadrature_formula(2);
 
-  const unsigned int   dofs_per_cell = fe.dofs_per_cell;
-  const unsigned int   n_q_points    = quadrature_formula.size();
+      FEValues<dim> fe_values (fe, quadrature_formula,
+                               update_values    |  update_gradients |
+                               update_quadrature_points  |  update_JxW_values);
 
-  FullMatrix<double>   cell_matrix (dofs_per_cell, dofs_per_cell);
-  Vector<double>       cell_rhs (dofs_per_cell);
+      const unsigned int   dofs_per_cell = fe.dofs_per_cell;
+      const unsigned int   n_q_points    = quadrature_formula.size();
 
-  std::vector<types::global_dof_index> local_dof_indices (dofs_per_cell);
+      FullMatrix<double>   cell_matrix (dofs_per_cell, dofs_per_cell);
+      Vector<double>       cell_rhs (dofs_per_cell);
 
-  typename DoFHandler<dim>::active_cell_iterator
-  cell = dof_handler.begin_active(),
-  endc = dof_handler.end();
-  for (; cell!=endc; ++cell)
-    {
-      cell_matrix = 0;
-      cell_rhs = 0;
+      std::vector<types::global_dof_index> local_dof_indices (dofs_per_cell);
 
-      fe_values.reinit (cell);
+      BatchedScatter scatter;
 
-      for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
+      typename DoFHandler<dim>::active_cell_iterator
+      cell = dof_handler.begin_active(),
+      endc = dof_handler.end();
+      for (; cell!=endc; ++cell)
         {
-          const double current_coefficient = coefficient<dim>
-                                             (fe_values.quadrature_point (q_index));
-          for (unsigned int i=0; i<dofs_per_cell; ++i)
+          cell_matrix = 0;
+          cell_rhs = 0;
+
+          fe_values.reinit (cell);
+
+          for (unsigned int q_index=0; q_index<n_q_points; ++q_index)
             {
-              for (unsigned int j=0; j<dofs_per_cell; ++j)
-                cell_matrix(i,j) += (current_coefficient *
-                                     fe_values.shape_grad(i,q_index) *
-                                     fe_values.shape_grad(j,q_index) *
-                                     fe_values.JxW(q_index));
-
-              cell_rhs(i) += (fe_values.shape_value(i,q_index) *
-                              1.0 *
-                              fe_values.JxW(q_index));
+              const double current_coefficient
+                = coefficient<dim> (fe_values.quadrature_point (q_index));
+              for (unsigned int i=0; i<dofs_per_cell; ++i)
+                {
+                  for (unsigned int j=0; j<dofs_per_cell; ++j)
+                    cell_matrix(i,j) += (current_coefficient *
+                                         fe_values.shape_grad(i,q_index) *
+                                         fe_values.shape_grad(j,q_index) *
+                                         fe_values.JxW(q_index));
+
+                  cell_rhs(i) += (fe_values.shape_value(i,q_index) *
+                                  1.0 *
+                                  fe_values.JxW(q_index));
+                }
             }
-        }
 
 
-      cell->get_dof_indices (local_dof_indices);
-      for (unsigned int i=0; i<dofs_per_cell; ++i)
-        {
-          for (unsigned int j=0; j<dofs_per_cell; ++j)
-            system_matrix.add (local_dof_indices[i],
-                               local_dof_indices[j],
-                               cell_matrix(i,j));
-
-          system_rhs(local_dof_indices[i]) += cell_rhs(i);
+          cell->get_dof_indices (local_dof_indices);
+          scatter.add (cell_matrix, cell_rhs, local_dof_indices,
+                       system_matrix, system_rhs);
         }
     }
 
@@ -196,15 +212,14 @@ template <int dim>
 void Step5<dim>::solve ()
 {
   SolverControl           solver_control (1000, 1e-12);
-  SolverCG<>              solver (solver_control);
 
-  PreconditionSSOR<> preconditioner;
-  preconditioner.initialize(system_matrix, 1.2);
+  // SSOR with omega = 1.2 unless another preconditioner was selected on
+  // the command line.
+  const unsigned int n_iterations
+    = preconditioner_factory.solve (system_matrix, solution, system_rhs,
+                                    solver_control).n_iterations;
 
-  solver.solve (system_matrix, solution, system_rhs,
-                preconditioner);
-
-  std::cout << "   " << solver_control.last_step()
+  std::cout << "   " << n_iterations
             << " CG iterations needed to obtain convergence."
             << std::endl;
 }
@@ -253,15 +268,23 @@ void Step5<dim>::run ()
   grid_in.read_ucd (input_file);
 
   static const SphericalManifold<dim> boundary;
+  static const CachedManifold<dim> cached_boundary(boundary);
   triangulation.set_all_manifold_ids_on_boundary(0);
-  triangulation.set_manifold (0, boundary);
+  triangulation.set_manifold (0, cached_boundary);
 
   for (unsigned int cycle=0; cycle<6; ++cycle)
     {
       std::cout << "Cycle " << cycle << ':' << std::endl;
 
+      // The new boundary points are computed in parallel before the
+      // refinement, which then finds them in the manifold's cache.
       if (cycle != 0)
-        triangulation.refine_global (1);
+        {
+          triangulation.set_all_refine_flags ();
+          prefetch_refinement_points (triangulation);
+          triangulation.execute_coarsening_and_refinement ();
+          cached_boundary.clear ();
+        }
 
       std::cout << "   Number of active cells: "
                 << triangulation.n_active_cells()
@@ -279,9 +302,22 @@ void Step5<dim>::run ()
 
 
 
-int main ()
+int main (int argc, char **argv)
 {
-  Step5<2> laplace_problem_2d;
+  // Trilinos, used by the AMG preconditioner, needs MPI.
+  Utilities::MPI::MPI_InitFinalize mpi_initialization (argc, argv, -1);
+
+  // Pass --preconditioner=<type> or --parameters=<file> to choose the
+  // preconditioner, see PreconditionerFactory. --assembly-kernels assembles
+  // with loops specialized for the degree of the element.
+  PreconditionerFactory preconditioner_factory;
+  preconditioner_factory.parse_command_line (argc, argv);
+  bool use_assembly_kernels = false;
+  for (int i=1; i<argc; ++i)
+    if (std::string (argv[i]) == "--assembly-kernels")
+      use_assembly_kernels = true;
+
+  Step5<2> laplace_problem_2d (use_assembly_kernels, preconditioner_factory);
   laplace_problem_2d.run ();
   return 0;
 }